@@ -0,0 +1,229 @@
+/**
+ * Summary: Microbenchmark comparing the incremental request parser (with every available
+ *          delimiter scanner) against the original strtok_r/sscanf/uthash parser.
+ *          Build and run with `make bench` (add CFLAGS="-Wall -O2" for optimized numbers).
+ *
+ * @file parser_bench.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE
+
+#include "http_parser.h"
+#include "token_scan.h"
+#include "../lib/uthash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 200000
+
+// a browser-like request with a large header set (~1.3 KB)
+static const char *sample_request =
+    "GET /paintings-nested.json?page=2&sort=artist HTTP/1.1\r\n"
+    "Host: localhost:6767\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+    "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Referer: http://localhost:6767/stats\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-CA,en-US;q=0.9,en;q=0.8,fr;q=0.7\r\n"
+    "If-None-Match: \"6630f1c2-99785\"\r\n"
+    "If-Modified-Since: Tue, 30 Apr 2024 13:37:06 GMT\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; "
+    "_ga=GA1.1.1234567890.1714481234; _ga_XYZ123=GS1.1.1714481234.3.1.1714481300.0.0.0; "
+    "prefs=eyJsYW5nIjoiZW4iLCJ0eiI6IkFtZXJpY2EvRWRtb250b24iLCJ2aWV3IjoiZ3JpZCJ9; "
+    "csrftoken=Zm9vYmFyYmF6cXV4cXV1eGNvcmdlZ3JhdWx0Z2FycGx5d2FsZG9mcmVk\r\n"
+    "\r\n";
+
+// --- the parser as it was before the incremental state machine ---
+typedef struct LegacyHeader
+{
+    char key[64];
+    char value[256];
+    UT_hash_handle hh;
+} LegacyHeader;
+
+typedef struct LegacyRequest
+{
+    char method[10];
+    char path[1024];
+    char version[10];
+    LegacyHeader *headers;
+} LegacyRequest;
+
+// --- FUNCTION DECLERATIONS ---
+int legacy_parse(const char *buffer, size_t len, LegacyRequest *rq);
+void legacy_free(LegacyRequest *rq);
+double now_ns();
+double bench_legacy(const char *request, size_t len);
+double bench_state_machine(const char *request, size_t len, TokenScanner scanner);
+
+// --- FUNCTIONS ---
+int main()
+{
+    size_t len = strlen(sample_request);
+    double legacy = bench_legacy(sample_request, len);
+
+    printf("request: %zu bytes, %d iterations\n", len, ITERATIONS);
+    printf("%-22s %10.1f ns/request\n", "strtok_r+sscanf+uthash", legacy);
+
+    struct
+    {
+        const char *name;
+        TokenScanner scanner;
+        int supported;
+    } scanners[] = {
+        {"state machine scalar", scan_token_scalar, 1},
+#if defined(__x86_64__) || defined(__i386__)
+        {"state machine sse2", scan_token_sse2, __builtin_cpu_supports("sse2")},
+        {"state machine sse4.2", scan_token_sse42, __builtin_cpu_supports("sse4.2")},
+        {"state machine avx2", scan_token_avx2, __builtin_cpu_supports("avx2")},
+#endif
+    };
+
+    for (size_t i = 0; i < sizeof(scanners) / sizeof(scanners[0]); i++)
+    {
+        if (!scanners[i].supported)
+        {
+            printf("%-22s %10s\n", scanners[i].name, "n/a");
+            continue;
+        }
+        double ns = bench_state_machine(sample_request, len, scanners[i].scanner);
+        printf("%-22s %10.1f ns/request  (%.2fx legacy)\n", scanners[i].name, ns, legacy / ns);
+    }
+    return 0;
+}
+
+/**
+ * @brief The original parser: copy, strtok_r the lines, sscanf the request
+ *        line and malloc one uthash entry per header.
+ *
+ * @param buffer The raw request.
+ * @param len Length of the request.
+ * @param rq The request to fill.
+ * @return 200 on success, 400 or 500 on failure.
+ */
+int legacy_parse(const char *buffer, size_t len, LegacyRequest *rq)
+{
+    char *buffer_copy = strndup(buffer, len);
+    if (buffer_copy == NULL)
+        return 500;
+
+    char *saveptr_line;
+    char *line_token = strtok_r(buffer_copy, "\n", &saveptr_line);
+    if (line_token == NULL ||
+        sscanf(line_token, "%9s%1023s%9s", rq->method, rq->path, rq->version) != 3)
+    {
+        free(buffer_copy);
+        return 400;
+    }
+
+    while ((line_token = strtok_r(NULL, "\n", &saveptr_line)) != NULL)
+    {
+        char *value = strchr(line_token, ':');
+        if (value == NULL)
+            continue;
+        *value++ = '\0';
+        while (*value == ' ')
+            value++;
+
+        LegacyHeader *s = (LegacyHeader *)malloc(sizeof(LegacyHeader));
+        strncpy(s->key, line_token, sizeof(s->key));
+        s->key[sizeof(s->key) - 1] = '\0';
+        strncpy(s->value, value, sizeof(s->value));
+        s->value[sizeof(s->value) - 1] = '\0';
+        HASH_ADD_STR(rq->headers, key, s);
+    }
+
+    free(buffer_copy);
+    return 200;
+}
+
+/**
+ * @brief Frees the header table built by legacy_parse().
+ *
+ * @param rq The parsed request.
+ */
+void legacy_free(LegacyRequest *rq)
+{
+    LegacyHeader *current, *tmp;
+    HASH_ITER(hh, rq->headers, current, tmp)
+    {
+        HASH_DEL(rq->headers, current);
+        free(current);
+    }
+}
+
+/**
+ * @brief Current monotonic time in nanoseconds.
+ *
+ * @return Nanoseconds since an arbitrary starting point.
+ */
+double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Times the original parser, including freeing its header table.
+ *
+ * @param request The raw request.
+ * @param len Length of the request.
+ * @return Average nanoseconds per request.
+ */
+double bench_legacy(const char *request, size_t len)
+{
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        LegacyRequest rq;
+        rq.headers = NULL;
+        if (legacy_parse(request, len, &rq) != 200)
+        {
+            printf(" - ❌ Error: legacy parser rejected the sample request\n");
+            exit(1);
+        }
+        legacy_free(&rq);
+    }
+    return (now_ns() - start) / ITERATIONS;
+}
+
+/**
+ * @brief Times the incremental parser with one particular delimiter scanner.
+ *
+ * @param request The raw request.
+ * @param len Length of the request.
+ * @param scanner The scanner implementation to install.
+ * @return Average nanoseconds per request.
+ */
+double bench_state_machine(const char *request, size_t len, TokenScanner scanner)
+{
+    static RequestParser parser; // as big as the one inside each Connection
+    scan_token = scanner;
+
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        parser_reset(&parser);
+        if (parser_feed(&parser, request, len) != 1 || parser.pos != len)
+        {
+            printf(" - ❌ Error: state machine rejected the sample request\n");
+            exit(1);
+        }
+    }
+    return (now_ns() - start) / ITERATIONS;
+}
@@ -0,0 +1,312 @@
+/**
+ * Summary: Microbenchmark comparing the lock-free work queue the thread pools use against the
+ *          mutex + condition variable queue it replaced. Measures hand-off throughput and the
+ *          latency from push to pop for a few producer/consumer mixes.
+ *          Build and run with `make bench` (add CFLAGS="-Wall -O2" for optimized numbers).
+ *
+ * @file queue_bench.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE
+
+#include "work_queue.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ITEMS 400000
+#define QUEUE_CAPACITY 16 // MAX_SOCKETS
+#define MAX_THREADS 8
+
+typedef struct Job
+{
+    double pushed_ns;
+} Job;
+
+// --- the queue as it was before the lock-free ring ---
+typedef struct LockedQueue
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    void *items[QUEUE_CAPACITY];
+    int head;
+    int tail;
+    int count;
+} LockedQueue;
+
+typedef struct Bench
+{
+    int lock_free;
+    WorkQueue ring;
+    Parking idle;
+    LockedQueue locked;
+    int producers;
+    int consumers;
+    Job *jobs;
+} Bench;
+
+typedef struct Worker
+{
+    Bench *bench;
+    int index;
+    double latency_sum;
+    long popped;
+} Worker;
+
+static Job stop_job; // one per consumer ends the run
+
+// --- FUNCTION DECLERATIONS ---
+double now_ns();
+int locked_push(LockedQueue *queue, void *item);
+void *locked_pop(LockedQueue *queue);
+void bench_push(Bench *bench, void *item);
+void *bench_pop(Bench *bench);
+void *ring_pop(Bench *bench);
+void *producer_function(void *arg);
+void *consumer_function(void *arg);
+void run(int lock_free, int producers, int consumers);
+
+// --- FUNCTIONS ---
+int main()
+{
+    int mixes[][2] = {{1, 1}, {1, 4}, {4, 1}, {4, 4}};
+
+    printf("%d items, queue capacity %d\n", ITEMS, QUEUE_CAPACITY);
+    printf("%-14s %5s %5s %14s %18s\n", "queue", "prod", "cons", "Mitems/s", "push->pop ns");
+    for (size_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++)
+    {
+        run(0, mixes[i][0], mixes[i][1]);
+        run(1, mixes[i][0], mixes[i][1]);
+    }
+    return 0;
+}
+
+/**
+ * @brief Current monotonic time in nanoseconds.
+ *
+ * @return Nanoseconds since an arbitrary starting point.
+ */
+double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief The old enqueue(): one mutex for every producer and consumer,
+ *        signalling the condition variable on each push.
+ *
+ * @param queue The queue.
+ * @param item The item to add.
+ * @return 0 on success, -1 if the queue is full.
+ */
+int locked_push(LockedQueue *queue, void *item)
+{
+    int result = -1;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count < QUEUE_CAPACITY)
+    {
+        queue->items[queue->tail] = item;
+        queue->tail = (queue->tail + 1) % QUEUE_CAPACITY;
+        queue->count++;
+        pthread_cond_signal(&queue->cond);
+        result = 0;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return result;
+}
+
+/**
+ * @brief The old dequeue(): waits on the condition variable while empty.
+ *
+ * @param queue The queue.
+ * @return The oldest item.
+ */
+void *locked_pop(LockedQueue *queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0)
+    {
+        pthread_cond_wait(&queue->cond, &queue->mutex);
+    }
+    void *item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % QUEUE_CAPACITY;
+    queue->count--;
+    pthread_mutex_unlock(&queue->mutex);
+    return item;
+}
+
+/**
+ * @brief Pushes to whichever queue is under test. The server sheds work
+ *        when the queue is full; here the producer yields and retries so
+ *        every item is counted.
+ *
+ * @param bench The run.
+ * @param item The item to add.
+ */
+void bench_push(Bench *bench, void *item)
+{
+    while ((bench->lock_free ? work_queue_push(&bench->ring, item)
+                             : locked_push(&bench->locked, item)) < 0)
+    {
+        sched_yield();
+    }
+    if (bench->lock_free)
+        parking_notify(&bench->idle);
+}
+
+/**
+ * @brief Pops from whichever queue is under test.
+ *
+ * @param bench The run.
+ * @return The oldest item.
+ */
+void *bench_pop(Bench *bench)
+{
+    return bench->lock_free ? ring_pop(bench) : locked_pop(&bench->locked);
+}
+
+/**
+ * @brief Blocking pop on the ring, spinning then parking the way the pool's workers do.
+ *
+ * @param bench The run.
+ * @return The oldest item.
+ */
+void *ring_pop(Bench *bench)
+{
+    while (1)
+    {
+        for (int spin = 0; spin <= bench->idle.spin_limit; spin++)
+        {
+            void *item = work_queue_try_pop(&bench->ring);
+            if (item != NULL)
+                return item;
+            cpu_relax();
+        }
+
+        uint32_t seen = parking_prepare(&bench->idle);
+        void *item = work_queue_try_pop(&bench->ring);
+        if (item != NULL)
+        {
+            parking_cancel(&bench->idle);
+            return item;
+        }
+        parking_wait(&bench->idle, seen);
+    }
+}
+
+/**
+ * @brief Pushes this producer's share of the jobs, stamping each with the push time.
+ *
+ * @param arg The Worker describing this thread.
+ */
+void *producer_function(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    Bench *bench = worker->bench;
+
+    for (int i = worker->index; i < ITEMS; i += bench->producers)
+    {
+        Job *job = &bench->jobs[i];
+        job->pushed_ns = now_ns();
+        bench_push(bench, job);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Pops until the stop job, summing the push to pop latency.
+ *
+ * @param arg The Worker describing this thread.
+ */
+void *consumer_function(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+
+    for (;;)
+    {
+        Job *job = (Job *)bench_pop(worker->bench);
+        if (job == &stop_job)
+            break;
+        worker->latency_sum += now_ns() - job->pushed_ns;
+        worker->popped++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs one queue with one producer/consumer mix and prints the results.
+ *
+ * @param lock_free 1 for the work queue, 0 for the mutex + condvar queue.
+ * @param producers Number of producer threads.
+ * @param consumers Number of consumer threads.
+ */
+void run(int lock_free, int producers, int consumers)
+{
+    static Bench bench;
+    pthread_t producer_ids[MAX_THREADS], consumer_ids[MAX_THREADS];
+    Worker producer_args[MAX_THREADS], consumer_args[MAX_THREADS];
+
+    bench.lock_free = lock_free;
+    bench.producers = producers;
+    bench.consumers = consumers;
+    bench.jobs = calloc(ITEMS, sizeof(Job));
+    if (bench.jobs == NULL || work_queue_init(&bench.ring, QUEUE_CAPACITY) < 0)
+    {
+        printf(" - ❌ Error: out of memory\n");
+        exit(1);
+    }
+    parking_init(&bench.idle);
+    pthread_mutex_init(&bench.locked.mutex, NULL);
+    pthread_cond_init(&bench.locked.cond, NULL);
+    bench.locked.head = bench.locked.tail = bench.locked.count = 0;
+
+    double start = now_ns();
+    for (int i = 0; i < consumers; i++)
+    {
+        consumer_args[i] = (Worker){&bench, i, 0, 0};
+        pthread_create(&consumer_ids[i], NULL, consumer_function, &consumer_args[i]);
+    }
+    for (int i = 0; i < producers; i++)
+    {
+        producer_args[i] = (Worker){&bench, i, 0, 0};
+        pthread_create(&producer_ids[i], NULL, producer_function, &producer_args[i]);
+    }
+
+    for (int i = 0; i < producers; i++)
+    {
+        pthread_join(producer_ids[i], NULL);
+    }
+    for (int i = 0; i < consumers; i++)
+    {
+        bench_push(&bench, &stop_job);
+    }
+
+    double latency_sum = 0;
+    long popped = 0;
+    for (int i = 0; i < consumers; i++)
+    {
+        pthread_join(consumer_ids[i], NULL);
+        latency_sum += consumer_args[i].latency_sum;
+        popped += consumer_args[i].popped;
+    }
+    double elapsed = now_ns() - start;
+
+    if (popped != ITEMS)
+    {
+        printf(" - ❌ Error: %ld of %d items came out of the queue\n", popped, ITEMS);
+        exit(1);
+    }
+    printf("%-14s %5d %5d %14.2f %18.0f\n", lock_free ? "lock-free ring" : "mutex+condvar",
+           producers, consumers, ITEMS / elapsed * 1e3, latency_sum / popped);
+
+    work_queue_destroy(&bench.ring);
+    pthread_mutex_destroy(&bench.locked.mutex);
+    pthread_cond_destroy(&bench.locked.cond);
+    free(bench.jobs);
+}
@@ -0,0 +1,360 @@
+/**
+ * Summary: Binary access log. Each request becomes one 32-byte record holding only numbers, so
+ *          logging it costs a path hash, an atomic add to claim space and a few stores into a
+ *          shared file mapping, with no formatting, lock or syscall. Paths are interned: the first
+ *          record with a given path hash in a file is preceded by an entry holding the path itself.
+ *          Files are preallocated so appending never has to allocate disk blocks, and when one
+ *          fills up it is renamed to F.1 (older ones shift up to F.4) and a fresh one is started.
+ *          Two file slots alternate; a full file stays mapped until every writer still in it has
+ *          left, which the next rotation waits for before reusing its slot.
+ *          Use logdecode to read them.
+ *
+ * @file access_log.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE
+
+#include "access_log.h"
+#include "logger.h"
+#include "work_queue.h" // CACHE_LINE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ACCESS_LOG_MIN_SIZE 65536 // smallest file accepted, so a rotation is never due right away
+#define ACCESS_PATH_PROBES 32     // slots looked at before a path is simply written again
+#define ACCESS_APPEND_RETRIES 64  // tries to get space while another thread rotates the file
+
+// one slot for a mapped log file; slots are never freed, so a writer holding a stale
+// pointer can always count itself in and find out the file moved on
+typedef struct AccessLogFile
+{
+    char *map;       // NULL while the slot holds no file
+    size_t size;
+    unsigned writers __attribute__((aligned(CACHE_LINE)));              // writers between log_enter() and log_leave()
+    size_t offset __attribute__((aligned(CACHE_LINE)));                 // next free byte, claimed with an atomic add
+    uint32_t paths[ACCESS_PATH_SLOTS] __attribute__((aligned(CACHE_LINE))); // hashes interned in this file, 0 = empty
+} AccessLogFile;
+
+// --- ACCESS LOG GLOBALS ---
+const char *access_log_path = NULL;
+size_t access_log_size = 0;
+AccessLogFile access_files[2];    // the file being appended to and the one it replaced
+AccessLogFile *access_log = NULL; // slot being appended to, NULL when the access log is off
+uint64_t access_dropped = 0;      // records lost while a rotation was in progress or after it failed
+pthread_mutex_t rotate_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// --- FUNCTION DECLERATIONS ---
+int access_log_init(const char *path, size_t size);
+void access_log_request(int client_fd, const char *filepath, int status, uint64_t bytes,
+                        uint64_t started_ns);
+uint32_t access_path_hash(const char *path, size_t len);
+
+// --- HELPER FUNCTIONS ---
+int log_enter(AccessLogFile *file);
+void log_leave(AccessLogFile *file);
+char *reserve_entries(AccessLogFile *file, size_t len);
+int intern_path(AccessLogFile *file, uint32_t hash);
+void rotate_log(AccessLogFile *full);
+int open_log_file(AccessLogFile *file);
+void close_log_file(AccessLogFile *file);
+uint64_t clock_ns(clockid_t clock);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Creates the first access log file. Any file already at path is
+ *        rotated out of the way first, so each run starts a new file.
+ *
+ * @param path The log file.
+ * @param size Bytes to preallocate per file.
+ * @return 0 on success, -1 on failure.
+ */
+int access_log_init(const char *path, size_t size)
+{
+    if (size < ACCESS_LOG_MIN_SIZE)
+        size = ACCESS_LOG_MIN_SIZE;
+
+    access_log_path = path;
+    access_log_size = size / ACCESS_ENTRY_SIZE * ACCESS_ENTRY_SIZE;
+
+    if (open_log_file(&access_files[0]) < 0)
+        return -1;
+    __atomic_store_n(&access_log, &access_files[0], __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Appends one request to the access log (a no-op when it is off).
+ *
+ * @param client_fd Socket file descriptor of the client being served.
+ * @param filepath Path of the requested resource.
+ * @param status HTTP status code returned to the client.
+ * @param bytes Response bytes queued, headers included.
+ * @param started_ns CLOCK_MONOTONIC time the connection was handed to the pool.
+ */
+void access_log_request(int client_fd, const char *filepath, int status, uint64_t bytes,
+                        uint64_t started_ns)
+{
+    AccessLogFile *file = __atomic_load_n(&access_log, __ATOMIC_ACQUIRE);
+    if (file == NULL)
+        return;
+
+    size_t path_len = strnlen(filepath, ACCESS_PATH_MAX);
+    uint32_t hash = access_path_hash(filepath, path_len);
+    uint64_t elapsed_us = (clock_ns(CLOCK_MONOTONIC) - started_ns) / 1000;
+
+    for (int attempt = 0; file != NULL && attempt < ACCESS_APPEND_RETRIES; attempt++)
+    {
+        if (!log_enter(file))
+        {
+            file = __atomic_load_n(&access_log, __ATOMIC_ACQUIRE); // rotated since we looked
+            continue;
+        }
+
+        // a path new to this file goes in front of its record, claimed in the same add
+        size_t path_size = intern_path(file, hash) ? access_path_entry_size(path_len) : 0;
+        char *entry = reserve_entries(file, path_size + sizeof(AccessRecord));
+        if (entry == NULL)
+        {
+            log_leave(file);
+            sched_yield(); // the file is full; let whoever crossed the end open the next one
+            file = __atomic_load_n(&access_log, __ATOMIC_ACQUIRE);
+            continue;
+        }
+
+        if (path_size > 0)
+        {
+            AccessPath *path = (AccessPath *)entry;
+            path->length = (uint16_t)path_len;
+            path->path_hash = hash;
+            memcpy(entry + offsetof(AccessPath, path), filepath, path_len); // runs on past the struct
+            __atomic_store_n(&path->type, ACCESS_ENTRY_PATH, __ATOMIC_RELEASE);
+        }
+
+        AccessRecord *record = (AccessRecord *)(entry + path_size);
+        record->status = (uint16_t)status;
+        record->fd = client_fd;
+        record->time_ns = clock_ns(CLOCK_REALTIME);
+        record->bytes = bytes;
+        record->latency_us = elapsed_us > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed_us;
+        record->path_hash = hash;
+        __atomic_store_n(&record->type, ACCESS_ENTRY_REQUEST, __ATOMIC_RELEASE);
+        log_leave(file);
+        return;
+    }
+
+    __atomic_fetch_add(&access_dropped, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 32-bit FNV-1a hash of a path, never 0 (0 marks an empty intern slot).
+ *
+ * @param path The path.
+ * @param len Its length.
+ * @return The hash.
+ */
+uint32_t access_path_hash(const char *path, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)path[i];
+        hash *= 16777619u;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Counts the caller in as a writer of a file, if it is still the one being appended to.
+ *        Counting in first and checking second means a rotation either sees us and waits,
+ *        or we see the rotation and back off without touching the file.
+ *
+ * @param file The file the caller loaded from access_log.
+ * @return 1 if the caller may write to it (and must call log_leave()), 0 if it was rotated out.
+ */
+int log_enter(AccessLogFile *file)
+{
+    __atomic_fetch_add(&file->writers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&access_log, __ATOMIC_SEQ_CST) == file)
+        return 1;
+    log_leave(file);
+    return 0;
+}
+
+/**
+ * @brief Counts a writer out of a file again.
+ *
+ * @param file The file it was writing to.
+ */
+void log_leave(AccessLogFile *file)
+{
+    __atomic_fetch_sub(&file->writers, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Claims len bytes at the end of a file. The one writer whose claim
+ *        crosses the end of the file starts the rotation.
+ *
+ * @param file The file to append to.
+ * @param len Bytes wanted (a multiple of ACCESS_ENTRY_SIZE).
+ * @return Where to write, or NULL if the file is full.
+ */
+char *reserve_entries(AccessLogFile *file, size_t len)
+{
+    size_t offset = __atomic_fetch_add(&file->offset, len, __ATOMIC_RELAXED);
+    if (offset + len <= file->size)
+        return file->map + offset;
+
+    // every later claim starts past the end, so exactly one writer gets here with offset <= size
+    if (offset <= file->size)
+        rotate_log(file);
+    return NULL;
+}
+
+/**
+ * @brief Records a path hash in a file's intern table.
+ *
+ * @param file The file the record is going to.
+ * @param hash The path hash.
+ * @return 1 if the caller must write the path entry, 0 if the file already has it.
+ */
+int intern_path(AccessLogFile *file, uint32_t hash)
+{
+    for (uint32_t probe = 0; probe < ACCESS_PATH_PROBES; probe++)
+    {
+        uint32_t *slot = &file->paths[(hash + probe) & (ACCESS_PATH_SLOTS - 1)];
+        uint32_t seen = __atomic_load_n(slot, __ATOMIC_RELAXED);
+        if (seen == hash)
+            return 0;
+        if (seen == 0)
+        {
+            if (__atomic_compare_exchange_n(slot, &seen, hash, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                return 1;
+            if (seen == hash) // another thread interned the same path first
+                return 0;
+        }
+    }
+    return 1; // table crowded: writing the path again is cheaper than looking further
+}
+
+/**
+ * @brief Replaces a full file with a new one in the other slot. The file that slot
+ *        held was retired by the previous rotation; it is unmapped once the last writer
+ *        still in it has left. The full file stays mapped the same way until the next one.
+ *
+ * @param full The file that filled up (the caller is counted in as one of its writers).
+ */
+void rotate_log(AccessLogFile *full)
+{
+    pthread_mutex_lock(&rotate_mutex);
+
+    AccessLogFile *file = full == &access_files[0] ? &access_files[1] : &access_files[0];
+    while (__atomic_load_n(&file->writers, __ATOMIC_SEQ_CST) != 0)
+    {
+        sched_yield(); // a writer is finishing a record, or backing off after seeing a rotation
+    }
+    if (file->map != NULL)
+        close_log_file(file);
+
+    if (open_log_file(file) < 0)
+    {
+        LOG(LOG_ERROR, " - ❌ Error: could not rotate the access log, it is now off");
+        file = NULL;
+    }
+    __atomic_store_n(&access_log, file, __ATOMIC_SEQ_CST);
+
+    uint64_t dropped = __atomic_exchange_n(&access_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0)
+        LOG(LOG_WARN, " - ⚠️ Warning: %lu access log records dropped", (unsigned long)dropped);
+
+    pthread_mutex_unlock(&rotate_mutex);
+}
+
+/**
+ * @brief Moves the current file to F.1 (shifting older ones up to F.ACCESS_LOG_KEEP),
+ *        then creates, preallocates and maps a new one into a free slot and writes its header.
+ *
+ * @param file The slot to fill; no writer may be in it.
+ * @return 0 on success, -1 on failure.
+ */
+int open_log_file(AccessLogFile *file)
+{
+    char from[4096], to[4096];
+    for (int i = ACCESS_LOG_KEEP - 1; i >= 0; i--)
+    {
+        if (i == 0)
+            snprintf(from, sizeof(from), "%s", access_log_path);
+        else
+            snprintf(from, sizeof(from), "%s.%d", access_log_path, i);
+        snprintf(to, sizeof(to), "%s.%d", access_log_path, i + 1);
+        rename(from, to); // fails harmlessly when there is no such file yet
+    }
+
+    int fd = open(access_log_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror(" - ❌ Error: could not open access log");
+        return -1;
+    }
+
+    // reserve the blocks now so page faults while appending never allocate on disk
+    if (posix_fallocate(fd, 0, access_log_size) != 0 && ftruncate(fd, access_log_size) < 0)
+    {
+        perror(" - ❌ Error: could not preallocate access log");
+        close(fd);
+        return -1;
+    }
+
+    char *map = mmap(NULL, access_log_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror(" - ❌ Error: could not map access log");
+        return -1;
+    }
+
+    memset(file->paths, 0, sizeof(file->paths));
+    file->map = map;
+    file->size = access_log_size;
+    file->offset = sizeof(AccessLogHeader);
+
+    AccessLogHeader *header = (AccessLogHeader *)map;
+    memcpy(header->magic, ACCESS_LOG_MAGIC, sizeof(header->magic));
+    header->version = ACCESS_LOG_VERSION;
+    header->entry_size = ACCESS_ENTRY_SIZE;
+    header->created_ns = clock_ns(CLOCK_REALTIME);
+    header->size = access_log_size;
+    return 0;
+}
+
+/**
+ * @brief Unmaps a file (the kernel writes back what is left), leaving its slot empty.
+ *
+ * @param file The file; no writer may be in it.
+ */
+void close_log_file(AccessLogFile *file)
+{
+    munmap(file->map, file->size);
+    file->map = NULL;
+}
+
+/**
+ * @brief Reads a clock in nanoseconds.
+ *
+ * @param clock CLOCK_REALTIME or CLOCK_MONOTONIC.
+ * @return Nanoseconds on that clock.
+ */
+uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
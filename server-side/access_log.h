@@ -0,0 +1,73 @@
+/**
+ * Summary: Header file for the binary access log: one fixed-size record per request, appended
+ *          into a preallocated memory-mapped file that is rotated when full. The layout below is
+ *          shared with the logdecode tool, which turns a log file back into text or JSON.
+ *
+ * @file access_log.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ACCESS_LOG_MAGIC "HTTPACC1"  // first 8 bytes of every access log file
+#define ACCESS_LOG_VERSION 1
+#define ACCESS_ENTRY_SIZE 32         // records and path entries are multiples of this
+#define ACCESS_PATH_MAX 1024         // longest path kept in the path table
+#define ACCESS_PATH_SLOTS 4096       // interned path hashes remembered per file
+#define ACCESS_LOG_KEEP 4            // rotated files kept: F.1 (newest) to F.4
+#define DEFAULT_ACCESS_LOG_MB 64     // size each file is preallocated to (-S)
+
+// what an entry holds; FREE is the zeroed, preallocated space (or an entry still being written)
+typedef enum AccessEntryType
+{
+    ACCESS_ENTRY_FREE = 0,
+    ACCESS_ENTRY_REQUEST,
+    ACCESS_ENTRY_PATH
+} AccessEntryType;
+
+// start of the file (64 bytes), entries follow it
+typedef struct AccessLogHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t created_ns; // CLOCK_REALTIME
+    uint64_t size;       // bytes preallocated, header included
+    uint8_t reserved[32];
+} AccessLogHeader;
+
+// one served request (32 bytes); type is stored last, so readers never see half a record
+typedef struct AccessRecord
+{
+    uint16_t type;
+    uint16_t status;
+    int32_t fd;
+    uint64_t time_ns;    // CLOCK_REALTIME when the response was queued
+    uint64_t bytes;      // response bytes, headers included
+    uint32_t latency_us; // from the event loop queuing the connection to the response being queued
+    uint32_t path_hash;  // FNV-1a of the path, resolved through the file's path entries
+} AccessRecord;
+
+// interns a path: written once per file before the first record that uses its hash.
+// the path runs on past this entry and is padded to a whole number of entries
+typedef struct AccessPath
+{
+    uint16_t type;
+    uint16_t length;
+    uint32_t path_hash;
+    char path[24];
+} AccessPath;
+
+int access_log_init(const char *path, size_t size);
+void access_log_request(int client_fd, const char *filepath, int status, uint64_t bytes,
+                        uint64_t started_ns);
+uint32_t access_path_hash(const char *path, size_t len);
+
+// bytes a path entry for a path of len bytes takes up
+#define access_path_entry_size(len) \
+    (((offsetof(AccessPath, path) + (len)) + ACCESS_ENTRY_SIZE - 1) / ACCESS_ENTRY_SIZE * ACCESS_ENTRY_SIZE)
+
+#endif
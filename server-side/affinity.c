@@ -0,0 +1,228 @@
+/**
+ * Summary: CPU lists and thread pinning. With -a, each shard gets a slice of the given cores: its
+ *          event loop is pinned to the slice and each worker to one core of it. Threads are pinned
+ *          before they run, so under Linux's default first-touch policy the buffers they allocate
+ *          land on their own NUMA node. SO_INCOMING_CPU ties sockets to the core that handled
+ *          their receive interrupt.
+ *
+ * @file affinity.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE // cpu_set_t, pthread_attr_setaffinity_np()
+
+#include "affinity.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+// --- FUNCTION DECLERATIONS ---
+int cpu_list_parse(const char *text, CpuList *list);
+void cpu_list_slice(const CpuList *list, int part, int parts, CpuList *out);
+int pin_attr(pthread_attr_t *attr, const CpuList *list);
+int pin_attr_cpu(pthread_attr_t *attr, int cpu);
+int pin_self(const CpuList *list);
+int socket_incoming_cpu(int fd);
+int set_incoming_cpu(int fd, int cpu);
+
+// --- HELPER FUNCTIONS ---
+void cpu_list_to_set(const CpuList *list, cpu_set_t *set);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Parses a CPU list in taskset/cpuset syntax ("0-3,8,10-11").
+ *        "all" means every CPU the process may run on.
+ *
+ * @param text The list to parse.
+ * @param list Receives the CPUs in the order given.
+ * @return 0 on success, -1 on a malformed or empty list or a CPU the process may not use.
+ */
+int cpu_list_parse(const char *text, CpuList *list)
+{
+    cpu_set_t allowed;
+    list->count = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        return -1;
+
+    if (text[0] == 'a' && text[1] == 'l' && text[2] == 'l' && text[3] == '\0')
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE && list->count < MAX_CPUS; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+                list->cpus[list->count++] = cpu;
+        }
+        return list->count > 0 ? 0 : -1;
+    }
+
+    const char *p = text;
+    while (*p != '\0')
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0)
+            return -1;
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return -1;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (cpu >= CPU_SETSIZE || list->count == MAX_CPUS || !CPU_ISSET(cpu, &allowed))
+                return -1;
+            list->cpus[list->count++] = (int)cpu;
+        }
+
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return list->count > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Splits a list into parts contiguous slices and returns one of them,
+ *        so shards get cores that are next to each other (usually one node).
+ *        When there are more parts than CPUs, parts share CPUs round-robin.
+ *
+ * @param list The whole list.
+ * @param part Which slice, 0 based.
+ * @param parts Number of slices.
+ * @param out Receives the slice (count 0 if list is empty).
+ */
+void cpu_list_slice(const CpuList *list, int part, int parts, CpuList *out)
+{
+    out->count = 0;
+    if (list->count == 0 || parts < 1)
+        return;
+
+    if (parts >= list->count)
+    {
+        out->cpus[out->count++] = list->cpus[part % list->count];
+        return;
+    }
+
+    int start = (int)((long)list->count * part / parts);
+    int end = (int)((long)list->count * (part + 1) / parts);
+    for (int i = start; i < end; i++)
+    {
+        out->cpus[out->count++] = list->cpus[i];
+    }
+}
+
+/**
+ * @brief Makes threads created with attr start pinned to the CPUs in list.
+ *
+ * @param attr Thread attributes to modify.
+ * @param list CPUs the thread may run on; an empty list leaves attr alone.
+ * @return 0 on success, -1 on failure.
+ */
+int pin_attr(pthread_attr_t *attr, const CpuList *list)
+{
+    if (list->count == 0)
+        return 0;
+
+    cpu_set_t set;
+    cpu_list_to_set(list, &set);
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Makes threads created with attr start pinned to one CPU.
+ *
+ * @param attr Thread attributes to modify.
+ * @param cpu The CPU, or -1 to leave attr alone.
+ * @return 0 on success, -1 on failure.
+ */
+int pin_attr_cpu(pthread_attr_t *attr, int cpu)
+{
+    if (cpu < 0)
+        return 0;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Pins the calling thread to the CPUs in list.
+ *
+ * @param list CPUs to run on; an empty list is a no-op.
+ * @return 0 on success, -1 on failure.
+ */
+int pin_self(const CpuList *list)
+{
+    if (list->count == 0)
+        return 0;
+
+    cpu_set_t set;
+    cpu_list_to_set(list, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        fprintf(stderr, " - ⚠️ Warning: could not pin thread to its CPUs\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Asks the kernel which CPU handled the socket's most recent receive.
+ *
+ * @param fd A connected socket.
+ * @return The CPU number, or -1 if unknown or unsupported.
+ */
+int socket_incoming_cpu(int fd)
+{
+#ifdef SO_INCOMING_CPU
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0)
+        return cpu;
+#endif
+    (void)fd;
+    return -1;
+}
+
+/**
+ * @brief On a SO_REUSEPORT listener, prefers connections whose packets were
+ *        received on cpu, so each shard accepts the traffic of its own cores.
+ *
+ * @param fd The listening socket.
+ * @param cpu The CPU to prefer.
+ * @return 0 on success, -1 if unsupported or failed.
+ */
+int set_incoming_cpu(int fd, int cpu)
+{
+#ifdef SO_INCOMING_CPU
+    return setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+#else
+    (void)fd;
+    (void)cpu;
+    return -1;
+#endif
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Converts a CPU list to the cpu_set_t the pthread calls take.
+ *
+ * @param list The CPUs.
+ * @param set Receives the set.
+ */
+void cpu_list_to_set(const CpuList *list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    for (int i = 0; i < list->count; i++)
+    {
+        CPU_SET(list->cpus[i], set);
+    }
+}
@@ -0,0 +1,30 @@
+/**
+ * Summary: Header file for CPU lists and thread pinning, used to keep each shard's acceptor and
+ *          workers (and the memory they first touch) on one set of cores.
+ *
+ * @file affinity.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <pthread.h>
+
+#define MAX_CPUS 1024
+
+// an ordered list of CPU numbers, e.g. parsed from "0-3,8-11"; count 0 means "not pinned"
+typedef struct CpuList
+{
+    int cpus[MAX_CPUS];
+    int count;
+} CpuList;
+
+int cpu_list_parse(const char *text, CpuList *list);
+void cpu_list_slice(const CpuList *list, int part, int parts, CpuList *out);
+int pin_attr(pthread_attr_t *attr, const CpuList *list);
+int pin_attr_cpu(pthread_attr_t *attr, int cpu);
+int pin_self(const CpuList *list);
+int socket_incoming_cpu(int fd);
+int set_incoming_cpu(int fd, int cpu);
+
+#endif
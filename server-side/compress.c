@@ -0,0 +1,92 @@
+/**
+ * Summary: On-the-fly gzip compression. Text types (as named by get_mime_type()) between
+ *          COMPRESS_MIN_FILE and COMPRESS_MAX_FILE are deflated with zlib the first time a client
+ *          that accepts gzip asks for them; images, PDFs and other already compressed types are
+ *          never touched. The result lives in the file cache as the file's gzip variant, where
+ *          it is revalidated and evicted like any other entry.
+ *
+ * @file compress.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#include "compress.h"
+#include "http_parser.h" // get_mime_type()
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+// --- COMPRESS GLOBALS ---
+int compress_level = 0; // 0 = off
+
+// --- FUNCTION DECLERATIONS ---
+void compress_init(int level);
+int compress_eligible(const char *filepath, size_t size);
+int gzip_buffer(const char *data, size_t len, char **out, size_t *out_len);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Sets the zlib level used on the fly.
+ *
+ * @param level 1 (fastest) to 9 (smallest), 0 to turn compression off.
+ */
+void compress_init(int level)
+{
+    compress_level = level < 0 ? 0 : level > Z_BEST_COMPRESSION ? Z_BEST_COMPRESSION : level;
+}
+
+/**
+ * @brief Tells whether a file is worth compressing on the fly: compression is
+ *        on, the size is in range and the type is text.
+ *
+ * @param filepath The file (its extension gives the type).
+ * @param size Its size.
+ * @return 1 if it should get a gzip variant, 0 otherwise.
+ */
+int compress_eligible(const char *filepath, size_t size)
+{
+    if (compress_level == 0 || size < COMPRESS_MIN_FILE || size > COMPRESS_MAX_FILE)
+        return 0;
+
+    const char *mime = get_mime_type(filepath);
+    return strncmp(mime, "text/", 5) == 0 || strcmp(mime, "application/javascript") == 0 ||
+           strcmp(mime, "application/json") == 0;
+}
+
+/**
+ * @brief Compresses a buffer into a gzip stream in one pass.
+ *
+ * @param data The bytes.
+ * @param len How many.
+ * @param out Receives the compressed bytes, allocated (NULL on failure).
+ * @param out_len Receives their length.
+ * @return 0 on success, -1 on failure or if compression saves less than COMPRESS_MIN_SAVING percent.
+ */
+int gzip_buffer(const char *data, size_t len, char **out, size_t *out_len)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    *out = NULL;
+
+    // windowBits 15 + 16 writes a gzip header and trailer instead of a zlib one
+    if (deflateInit2(&stream, compress_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    // anything larger than the saving allows is of no use, so the output never needs to grow
+    size_t limit = len - len * COMPRESS_MIN_SAVING / 100;
+    char *buffer = (char *)malloc(limit ? limit : 1);
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = (uInt)len;
+    stream.next_out = (Bytef *)buffer;
+    stream.avail_out = (uInt)limit;
+
+    int status = buffer != NULL ? deflate(&stream, Z_FINISH) : Z_MEM_ERROR;
+    *out_len = stream.total_out;
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END)
+    {
+        free(buffer); // Z_OK / Z_BUF_ERROR: it did not fit under the limit
+        return -1;
+    }
+    *out = buffer;
+    return 0;
+}
@@ -0,0 +1,23 @@
+/**
+ * Summary: Header file for on-the-fly gzip compression of text files that have no precompressed
+ *          sidecar. The compressed bodies are kept in the file cache, so each file is deflated
+ *          once per change.
+ *
+ * @file compress.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+
+#define DEFAULT_COMPRESS_LEVEL 6          // zlib level used on the fly (-z, 0 = off)
+#define COMPRESS_MIN_FILE 1024            // smaller files gain too little to be worth a variant
+#define COMPRESS_MAX_FILE (16 << 20)      // larger files would hold a worker too long on a miss
+#define COMPRESS_MIN_SAVING 8             // percent a variant must save, otherwise the file is sent as is
+
+void compress_init(int level);
+int compress_eligible(const char *filepath, size_t size);
+int gzip_buffer(const char *data, size_t len, char **out, size_t *out_len);
+
+#endif
@@ -0,0 +1,589 @@
+/**
+ * Summary: Implementation of per-client connection buffers and non-blocking response flushing.
+ *
+ * @file connection.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE // splice(), pipe2(), F_SETPIPE_SZ
+
+#include "connection.h"
+#include "event_loop.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// --- FUNCTION DECLERATIONS ---
+Connection *conn_create(int fd, struct EventLoop *loop);
+void conn_destroy(Connection *conn);
+int conn_write(Connection *conn, const void *data, size_t len);
+int conn_printf(Connection *conn, const char *fmt, ...);
+int conn_attach_file(Connection *conn, int file_fd, off_t offset, off_t length);
+int conn_attach_memory(Connection *conn, const void *data, size_t len, void (*release)(void *), void *owner);
+int conn_attach_shared_file(Connection *conn, int file_fd, off_t offset, off_t length, void (*release)(void *), void *owner);
+int conn_gather(Connection *conn, struct iovec *iov, int max_iov);
+int conn_body_follows(Connection *conn, int count);
+void conn_advance(Connection *conn, size_t sent);
+void conn_pop_segment(Connection *conn);
+int conn_flush(Connection *conn);
+int conn_open_pipe(Connection *conn);
+OutSegment *new_segment(Connection *conn);
+int reserve_segment(OutSegment *seg, size_t extra);
+int flush_file(Connection *conn, OutSegment *seg);
+int splice_file(Connection *conn, OutSegment *seg);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Allocates the state for a newly accepted client socket.
+ *
+ * @param fd The accepted (non-blocking) client socket file descriptor.
+ * @param loop The event loop that will own the socket.
+ * @return Pointer to the new connection, or NULL on allocation failure.
+ */
+Connection *conn_create(int fd, struct EventLoop *loop)
+{
+    Connection *conn = (Connection *)malloc(sizeof(Connection));
+    if (conn == NULL)
+    {
+        perror("failed to allocate Connection on the heap");
+        return NULL;
+    }
+
+    // responses are already coalesced into as few writes as possible, so Nagle would
+    // only hold back the last small packet waiting for a delayed ACK
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    conn->fd = fd;
+    conn->loop = loop;
+    conn->state = CONN_READING;
+    conn->peer_closed = 0;
+    conn->keep_alive = 0;
+    conn->requests_served = 0;
+    conn->worker = -1;
+    conn->enqueued_ns = 0;
+    conn->queued_bytes = 0;
+    conn->in_buf[0] = '\0';
+    conn->in_len = 0;
+    memset(&conn->parser, 0, sizeof(conn->parser));
+    conn->out_head = NULL;
+    conn->out_tail = NULL;
+    conn->pipe_fds[0] = -1;
+    conn->pipe_fds[1] = -1;
+    conn->pipe_bytes = 0;
+    conn->inflight = 0;
+    conn->failed = 0;
+    conn->next = NULL;
+    conn->last_active = 0;
+    conn->idle_list = -1;
+    conn->idle_prev = NULL;
+    conn->idle_next = NULL;
+    return conn;
+}
+
+/**
+ * @brief Closes the client socket, any queued file bodies and the splice pipe, then frees the connection.
+ *
+ * @param conn The connection to destroy.
+ */
+void conn_destroy(Connection *conn)
+{
+    idle_untrack(conn->loop, conn);
+
+    while (conn->out_head != NULL)
+    {
+        conn_pop_segment(conn);
+    }
+    if (conn->pipe_fds[0] >= 0)
+    {
+        close(conn->pipe_fds[0]);
+        close(conn->pipe_fds[1]);
+    }
+    close(conn->fd); // closing also removes the socket from any epoll set
+    free(conn);
+}
+
+/**
+ * @brief Appends response bytes to the connection's output queue.
+ *        Nothing is sent here; the event loop flushes the queue once the worker is done.
+ *
+ * @param conn The connection to write to.
+ * @param data The bytes to append.
+ * @param len The number of bytes to append.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int conn_write(Connection *conn, const void *data, size_t len)
+{
+    OutSegment *seg = conn->out_tail;
+
+    // bytes following a file body or borrowed memory need a segment of their own
+    if (seg == NULL || seg->data == NULL || seg->owner != NULL)
+    {
+        seg = new_segment(conn);
+        if (seg == NULL)
+            return -1;
+    }
+
+    if (reserve_segment(seg, len) < 0)
+        return -1;
+
+    memcpy(seg->data + seg->len, data, len);
+    seg->len += len;
+    conn->queued_bytes += len;
+    return 0;
+}
+
+/**
+ * @brief Formats response text straight into the connection's output queue,
+ *        so status lines, headers and small bodies end up contiguous and leave
+ *        in the same write without going through a fixed-size stack buffer.
+ *
+ * @param conn The connection to write to.
+ * @param fmt printf-style format string.
+ * @return 0 on success, -1 on allocation or formatting failure.
+ */
+int conn_printf(Connection *conn, const char *fmt, ...)
+{
+    OutSegment *seg = conn->out_tail;
+    va_list args;
+
+    if (seg == NULL || seg->data == NULL || seg->owner != NULL)
+    {
+        seg = new_segment(conn);
+        if (seg == NULL)
+            return -1;
+    }
+
+    // first try whatever room is left, then grow to the exact size and format again
+    va_start(args, fmt);
+    int needed = vsnprintf(seg->data + seg->len, seg->cap - seg->len, fmt, args);
+    va_end(args);
+    if (needed < 0)
+        return -1;
+
+    if ((size_t)needed >= seg->cap - seg->len)
+    {
+        if (reserve_segment(seg, needed + 1) < 0)
+            return -1;
+
+        va_start(args, fmt);
+        vsnprintf(seg->data + seg->len, seg->cap - seg->len, fmt, args);
+        va_end(args);
+    }
+    seg->len += needed;
+    conn->queued_bytes += needed;
+    return 0;
+}
+
+/**
+ * @brief Queues a range of an open file to be sent after the bytes already
+ *        queued. The connection takes ownership of file_fd and closes it when done.
+ *
+ * @param conn The connection the file belongs to.
+ * @param file_fd Open file descriptor of the file body.
+ * @param offset Where in the file the range starts.
+ * @param length The number of bytes to send.
+ * @return 0 on success, -1 on allocation failure (file_fd is closed right away).
+ */
+int conn_attach_file(Connection *conn, int file_fd, off_t offset, off_t length)
+{
+    OutSegment *seg = new_segment(conn);
+    if (seg == NULL)
+    {
+        close(file_fd);
+        return -1;
+    }
+
+    seg->file_fd = file_fd;
+    seg->file_off = offset;
+    seg->file_end = offset + length;
+    conn->queued_bytes += length;
+    return 0;
+}
+
+/**
+ * @brief Queues bytes the connection does not own, such as a cached file body,
+ *        without copying them. They go out in the same gathered write as the
+ *        memory segments around them; release(owner) is called once they are sent.
+ *
+ * @param conn The connection to write to.
+ * @param data The bytes, kept alive by owner until release.
+ * @param len The number of bytes.
+ * @param release Called with owner when the segment is done (or dropped).
+ * @param owner What holds the bytes.
+ * @return 0 on success, -1 on allocation failure (release is called right away).
+ */
+int conn_attach_memory(Connection *conn, const void *data, size_t len, void (*release)(void *), void *owner)
+{
+    if (len == 0)
+    {
+        release(owner); // an empty segment would never be popped by conn_advance()
+        return 0;
+    }
+
+    OutSegment *seg = new_segment(conn);
+    if (seg == NULL)
+    {
+        release(owner);
+        return -1;
+    }
+
+    seg->data = (char *)data;
+    seg->len = len;
+    seg->cap = len;
+    seg->release = release;
+    seg->owner = owner;
+    conn->queued_bytes += len;
+    return 0;
+}
+
+/**
+ * @brief Queues a range of a file the connection does not own, such as one held
+ *        open by the file cache or the pack. Sending always passes an explicit
+ *        offset, so several connections can stream the same fd at once;
+ *        release(owner) is called instead of closing it once the range is sent.
+ *
+ * @param conn The connection the file is sent on.
+ * @param file_fd Open file descriptor, kept open by owner until release.
+ * @param offset Where in the file the range starts.
+ * @param length The number of bytes to send.
+ * @param release Called with owner when the segment is done (or dropped).
+ * @param owner What holds the fd.
+ * @return 0 on success, -1 on allocation failure (release is called right away).
+ */
+int conn_attach_shared_file(Connection *conn, int file_fd, off_t offset, off_t length, void (*release)(void *), void *owner)
+{
+    OutSegment *seg = new_segment(conn);
+    if (seg == NULL)
+    {
+        release(owner);
+        return -1;
+    }
+
+    seg->file_fd = file_fd;
+    seg->file_off = offset;
+    seg->file_end = offset + length;
+    seg->release = release;
+    seg->owner = owner;
+    conn->queued_bytes += length;
+    return 0;
+}
+
+/**
+ * @brief Collects the unsent part of the leading memory segments into an iovec
+ *        array so they can leave in a single write. Stops at the first file segment.
+ *
+ * @param conn The connection to gather from.
+ * @param iov Array receiving the byte ranges.
+ * @param max_iov Capacity of the iov array.
+ * @return Number of entries filled in (0 if the queue starts with a file or is empty).
+ */
+int conn_gather(Connection *conn, struct iovec *iov, int max_iov)
+{
+    int count = 0;
+
+    for (OutSegment *seg = conn->out_head; seg != NULL && count < max_iov; seg = seg->next)
+    {
+        if (seg->data == NULL)
+            break;
+
+        iov[count].iov_base = seg->data + seg->sent;
+        iov[count].iov_len = seg->len - seg->sent;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Tells whether a file body with bytes left to send directly follows the
+ *        first count memory segments. The gathered bytes are then sent with
+ *        MSG_MORE so the headers share their packet with the start of the body.
+ *
+ * @param conn The connection being flushed.
+ * @param count Number of memory segments gathered by conn_gather().
+ * @return 1 if file bytes follow, 0 otherwise.
+ */
+int conn_body_follows(Connection *conn, int count)
+{
+    OutSegment *seg = conn->out_head;
+
+    for (int i = 0; i < count && seg != NULL; i++)
+    {
+        seg = seg->next;
+    }
+    return seg != NULL && seg->data == NULL &&
+           (seg->file_off < seg->file_end || conn->pipe_bytes > 0);
+}
+
+/**
+ * @brief Marks bytes of the leading memory segments as sent, freeing the
+ *        segments that are now fully written.
+ *
+ * @param conn The connection that sent the bytes.
+ * @param sent Number of bytes the socket accepted.
+ */
+void conn_advance(Connection *conn, size_t sent)
+{
+    while (sent > 0 && conn->out_head != NULL && conn->out_head->data != NULL)
+    {
+        OutSegment *seg = conn->out_head;
+        size_t left = seg->len - seg->sent;
+
+        if (sent < left)
+        {
+            seg->sent += sent;
+            return;
+        }
+        sent -= left;
+        conn_pop_segment(conn);
+    }
+}
+
+/**
+ * @brief Removes the first segment of the output queue, closing its file if it has one.
+ *
+ * @param conn The connection whose queue to pop.
+ */
+void conn_pop_segment(Connection *conn)
+{
+    OutSegment *seg = conn->out_head;
+    if (seg == NULL)
+        return;
+
+    conn->out_head = seg->next;
+    if (conn->out_head == NULL)
+        conn->out_tail = NULL;
+
+    if (seg->owner != NULL)
+    {
+        seg->release(seg->owner);
+    }
+    else
+    {
+        if (seg->file_fd >= 0)
+            close(seg->file_fd);
+        free(seg->data);
+    }
+    free(seg);
+}
+
+/**
+ * @brief Pushes as much of the queued responses to the socket as it will take.
+ *        Consecutive memory segments (e.g. the headers of several pipelined
+ *        responses) go out together in one gathered sendmsg(); when a file body
+ *        follows they are corked with MSG_MORE until sendfile() pushes the body.
+ *
+ * @param conn The connection to flush.
+ * @return 1 when everything was sent, 0 if the socket would block, -1 on error.
+ */
+int conn_flush(Connection *conn)
+{
+    struct iovec iov[OUT_IOV_MAX];
+
+    while (conn->out_head != NULL)
+    {
+        OutSegment *seg = conn->out_head;
+
+        if (seg->data == NULL)
+        {
+            int status = flush_file(conn, seg);
+            if (status != 1)
+                return status;
+            conn_pop_segment(conn);
+            continue;
+        }
+
+        int count = conn_gather(conn, iov, OUT_IOV_MAX);
+        struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+        int flags = conn_body_follows(conn, count) ? MSG_MORE : 0;
+
+        ssize_t sent = sendmsg(conn->fd, &msg, flags);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+        conn_advance(conn, sent);
+    }
+    return 1;
+}
+
+/**
+ * @brief Creates the connection's splice pipe if it does not exist yet.
+ *
+ * @param conn The connection that needs a pipe.
+ * @return The pipe capacity in bytes, or -1 on failure.
+ */
+int conn_open_pipe(Connection *conn)
+{
+    if (conn->pipe_fds[0] < 0)
+    {
+        if (pipe2(conn->pipe_fds, O_CLOEXEC) < 0)
+        {
+            perror(" - ❌ Error: pipe2 failed");
+            conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+            return -1;
+        }
+        fcntl(conn->pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE); // best effort
+    }
+
+    return fcntl(conn->pipe_fds[1], F_GETPIPE_SZ);
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Appends an empty segment to the connection's output queue.
+ *
+ * @param conn The connection to extend.
+ * @return The new segment, or NULL on allocation failure.
+ */
+OutSegment *new_segment(Connection *conn)
+{
+    OutSegment *seg = (OutSegment *)calloc(1, sizeof(OutSegment));
+    if (seg == NULL)
+    {
+        perror("failed to allocate OutSegment on the heap");
+        return NULL;
+    }
+    seg->file_fd = -1;
+
+    if (conn->out_tail)
+        conn->out_tail->next = seg;
+    else
+        conn->out_head = seg;
+    conn->out_tail = seg;
+    return seg;
+}
+
+/**
+ * @brief Sends the unsent part of a file segment without copying it through user space.
+ *        sendfile() moves the bytes straight from the page cache to the socket and
+ *        advances the segment offset itself, so a partial send just resumes there.
+ *        Files that sendfile() rejects go through the splice pipe instead.
+ *
+ * @param conn The connection being flushed.
+ * @param seg The file segment at the head of the queue.
+ * @return 1 when the file is fully sent, 0 if the socket would block, -1 on error.
+ */
+int flush_file(Connection *conn, OutSegment *seg)
+{
+    while (seg->file_off < seg->file_end || conn->pipe_bytes > 0)
+    {
+        // bytes already in the pipe must go out first to keep the body in order
+        if (conn->pipe_bytes == 0)
+        {
+            ssize_t sent = sendfile(conn->fd, seg->file_fd, &seg->file_off,
+                                    seg->file_end - seg->file_off);
+            if (sent > 0)
+                continue;
+            if (sent == 0)
+            {
+                LOG(LOG_ERROR, " - ❌ Error: file ended before its Content-Length was sent");
+                return -1;
+            }
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno != EINVAL && errno != ENOSYS)
+                return -1;
+        }
+
+        int status = splice_file(conn, seg);
+        if (status != 1)
+            return status;
+    }
+    return 1;
+}
+
+/**
+ * @brief Moves one pipe's worth of a file segment into the socket with splice().
+ *        Whatever the socket does not take stays in the pipe (counted in pipe_bytes)
+ *        and is sent on the next flush.
+ *
+ * @param conn The connection being flushed.
+ * @param seg The file segment at the head of the queue.
+ * @return 1 on progress, 0 if the socket would block, -1 on error.
+ */
+int splice_file(Connection *conn, OutSegment *seg)
+{
+    if (conn->pipe_bytes == 0)
+    {
+        int pipe_size = conn_open_pipe(conn);
+        if (pipe_size < 0)
+            return -1;
+
+        size_t want = pipe_size;
+        if ((off_t)want > seg->file_end - seg->file_off)
+        {
+            want = seg->file_end - seg->file_off;
+        }
+
+        ssize_t filled = splice(seg->file_fd, &seg->file_off, conn->pipe_fds[1], NULL, want,
+                                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (filled <= 0)
+        {
+            if (filled < 0 && errno == EINTR)
+                return 1;
+            LOG(LOG_ERROR, " - ❌ Error: failed to read file content");
+            return -1;
+        }
+        conn->pipe_bytes = filled;
+    }
+
+    ssize_t sent = splice(conn->pipe_fds[0], NULL, conn->fd, NULL, conn->pipe_bytes,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK |
+                              (seg->file_off < seg->file_end ? SPLICE_F_MORE : 0));
+    if (sent < 0)
+    {
+        if (errno == EINTR)
+            return 1;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return -1;
+    }
+    conn->pipe_bytes -= sent;
+    return 1;
+}
+
+/**
+ * @brief Makes sure a memory segment has room for extra more bytes,
+ *        doubling its capacity as needed.
+ *
+ * @param seg The memory segment to grow.
+ * @param extra Number of bytes about to be appended.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int reserve_segment(OutSegment *seg, size_t extra)
+{
+    if (seg->len + extra <= seg->cap)
+        return 0;
+
+    size_t new_cap = seg->cap ? seg->cap : OUT_BUFFER_MIN;
+    while (new_cap < seg->len + extra)
+    {
+        new_cap *= 2;
+    }
+
+    char *grown = (char *)realloc(seg->data, new_cap);
+    if (grown == NULL)
+    {
+        perror("failed to grow connection output buffer");
+        return -1;
+    }
+    seg->data = grown;
+    seg->cap = new_cap;
+    return 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * Summary: Header file defining the per-client connection state shared by the event loop and workers.
+ *
+ * @file connection.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CONN_BUFFER_SIZE 8192      // bytes of request data buffered per connection
+#define OUT_BUFFER_MIN 1024        // initial capacity of a connection's output buffer
+#define SPLICE_PIPE_SIZE 262144    // requested capacity of each connection's splice pipe
+#define KEEPALIVE_TIMEOUT 5        // seconds an idle persistent connection is kept open
+#define REQUEST_TIMEOUT 10         // seconds a client has to finish a request once it started sending it
+#define WRITE_TIMEOUT 30           // seconds a response may make no progress before the client is dropped
+#define KEEPALIVE_MAX_REQUESTS 100 // requests served on one connection before it is closed
+#define OUT_IOV_MAX 64             // queued memory segments gathered into one write
+#define MAX_HEADERS 64             // header lines remembered per request
+
+struct EventLoop;
+
+// where a connection currently is in its lifecycle
+typedef enum ConnState
+{
+    CONN_READING,    // event loop is waiting for a full request
+    CONN_PROCESSING, // a worker owns the connection and is building the response
+    CONN_WRITING     // event loop is flushing the response to the socket
+} ConnState;
+
+// where the request parser stopped; it resumes from here when more bytes arrive
+typedef enum ParseState
+{
+    PARSE_START,        // skipping blank lines before the request line
+    PARSE_METHOD,
+    PARSE_BEFORE_PATH,
+    PARSE_PATH,
+    PARSE_BEFORE_VERSION,
+    PARSE_VERSION,
+    PARSE_LINE_END,     // saw '\r', expecting '\n'
+    PARSE_HEADER_START, // start of a header line or of the closing blank line
+    PARSE_HEADER_KEY,
+    PARSE_BEFORE_VALUE,
+    PARSE_VALUE,
+    PARSE_IGNORED_LINE, // a header line without a colon, skipped
+    PARSE_HEADERS_END,  // saw the '\r' of the closing blank line
+    PARSE_DONE,
+    PARSE_ERROR
+} ParseState;
+
+// a byte range of the connection's receive buffer (CONN_BUFFER_SIZE fits in 16 bits)
+typedef struct Span
+{
+    uint16_t off;
+    uint16_t len;
+} Span;
+
+typedef struct HeaderSpan
+{
+    Span key;
+    Span value;
+} HeaderSpan;
+
+// incremental parser state, kept per connection so a request can arrive in any number of pieces
+typedef struct RequestParser
+{
+    ParseState state;
+    size_t pos;       // bytes of the receive buffer already examined
+    size_t mark;      // start of the token being scanned
+    size_t value_end; // end of the current header value without trailing blanks
+
+    Span method;
+    Span path;
+    Span version;
+    HeaderSpan headers[MAX_HEADERS];
+    int num_headers;
+} RequestParser;
+
+// one piece of a queued response: either bytes in memory or a range of an open file
+typedef struct OutSegment
+{
+    char *data;  // memory bytes, NULL for a file segment
+    size_t len;
+    size_t cap;
+    size_t sent;
+
+    // borrowed memory or fd (e.g. a cached file): belongs to owner, released instead of freed or closed
+    void (*release)(void *owner);
+    void *owner;
+
+    int file_fd; // file body, -1 for a memory segment (closed when the segment is done)
+    off_t file_off;
+    off_t file_end;
+
+    struct OutSegment *next;
+} OutSegment;
+
+typedef struct Connection
+{
+    int fd;                 // client socket (non-blocking)
+    struct EventLoop *loop; // event loop that owns the socket
+    ConnState state;
+    int peer_closed;        // client shut down its write side
+    int keep_alive;         // keep the socket open once the current response is sent
+    int requests_served;    // requests answered on this connection so far
+    int worker;             // index of the pool worker that served the last request, -1 before the first
+    uint64_t enqueued_ns;   // when it was last handed to the pool, for the supervisor's queue wait
+    uint64_t queued_bytes;  // response bytes queued on this connection so far, for the access log
+
+    // request bytes received so far (always null terminated)
+    char in_buf[CONN_BUFFER_SIZE];
+    size_t in_len;
+    RequestParser parser; // progress through the first request in in_buf
+
+    // responses waiting to go out, in request order
+    OutSegment *out_head;
+    OutSegment *out_tail;
+
+    // pipe used to splice file bodies into the socket (created on first use)
+    int pipe_fds[2];
+    size_t pipe_bytes; // bytes sitting in the pipe, not yet sent
+
+    // io_uring bookkeeping: operations still owned by the kernel
+    int inflight;
+    int failed; // a send failed, or a worker could only queue part of a response: close, do not flush
+    struct iovec out_iov[OUT_IOV_MAX]; // gathered memory segments of the send in flight
+    struct msghdr out_msg;
+
+    struct Connection *next; // link for the event loop's return list
+
+    // timeout list of the event loop the connection waits on, oldest first (only touched by the loop thread)
+    time_t last_active; // when the current wait started
+    int idle_list;      // IdleList it is linked on, -1 if none
+    struct Connection *idle_prev;
+    struct Connection *idle_next;
+} Connection;
+
+Connection *conn_create(int fd, struct EventLoop *loop);
+void conn_destroy(Connection *conn);
+int conn_write(Connection *conn, const void *data, size_t len);
+int conn_printf(Connection *conn, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int conn_attach_file(Connection *conn, int file_fd, off_t offset, off_t length);
+int conn_attach_memory(Connection *conn, const void *data, size_t len, void (*release)(void *), void *owner);
+int conn_attach_shared_file(Connection *conn, int file_fd, off_t offset, off_t length, void (*release)(void *), void *owner);
+int conn_gather(Connection *conn, struct iovec *iov, int max_iov);
+int conn_body_follows(Connection *conn, int count);
+void conn_advance(Connection *conn, size_t sent);
+void conn_pop_segment(Connection *conn);
+int conn_flush(Connection *conn);
+int conn_open_pipe(Connection *conn);
+
+#endif
@@ -0,0 +1,629 @@
+/**
+ * Summary: Document root index. At startup the document root is scanned into a hash table of
+ *          normalized URL paths, each mapped to the file it serves (a directory's URL maps to its
+ *          index.html). Request paths are normalized once, properly: query and fragment dropped,
+ *          percent escapes decoded, "." and ".." segments resolved and rejected if they would
+ *          leave the root. A lookup is then one hash probe with no syscall, and a missing file is
+ *          answered from the index without touching the disk. An inotify thread watches every
+ *          directory and, once a burst of changes has settled, rebuilds the index and swaps it in;
+ *          the old one is freed after every lookup that could still be reading it has finished.
+ *          Each file is also linked to its precompressed sidecars (.gz, .zst, .br next to it), so
+ *          Accept-Encoding is negotiated from the index too; a file written in place triggers a
+ *          rebuild as well, since a sidecar older than its file no longer counts.
+ *
+ * @file docroot.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE
+
+#include "docroot.h"
+#include "logger.h"
+#include "server.h" // PATH_LEN
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DOCROOT_MIN_SLOTS 64
+#define DOCROOT_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | \
+                            IN_CLOSE_WRITE)
+
+// --- DOCROOT GLOBALS ---
+const char *docroot_path = NULL;
+DocIndex *doc_index = NULL;  // current index, read by the workers without a lock
+unsigned index_phase = 0;    // which of index_readers a lookup starting now counts itself in
+unsigned index_readers[2];   // lookups in flight, by the phase they started in
+int inotify_fd = -1;
+const char *const encoding_names[NUM_ENCODINGS] = {"", "gzip", "zstd", "br"};
+const char *const encoding_suffixes[NUM_ENCODINGS] = {"", ".gz", ".zst", ".br"};
+
+// --- FUNCTION DECLERATIONS ---
+int docroot_init(const char *root);
+DocResult docroot_resolve(const char *url, size_t len, unsigned accepted, char *filepath, size_t size,
+                          DocVariant *variant);
+int normalize_path(const char *url, size_t len, char *out, size_t size);
+void *watch_function(void *arg);
+DocIndex *build_index(const char *root);
+void free_index(DocIndex *index);
+uint32_t url_hash(const char *url, size_t len);
+
+// --- HELPER FUNCTIONS ---
+unsigned index_enter();
+void index_leave(unsigned phase);
+void wait_for_readers();
+int scan_dir(DocIndex *index, char *fs_path, size_t fs_len, size_t root_len, int depth);
+int add_entry(DocIndex *index, const char *url, size_t url_len, const char *fs_path, const struct stat *st);
+const DocEntry *find_url(const DocIndex *index, const char *url, size_t len);
+void link_variants(DocIndex *index, size_t root_len);
+ContentEncoding pick_encoding(const DocEntry *entry, unsigned accepted);
+int hex_value(char c);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Scans the document root and starts watching it for changes.
+ *        Without inotify the index is still built, but not kept current.
+ *
+ * @param root The directory to serve.
+ * @return 0 on success, -1 if the root cannot be scanned.
+ */
+int docroot_init(const char *root)
+{
+    docroot_path = root;
+
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0)
+        LOG(LOG_WARN, " - ⚠️ Warning: inotify unavailable, changes to %s need a restart", root);
+
+    DocIndex *index = build_index(docroot_path);
+    if (index == NULL)
+    {
+        fprintf(stderr, " - ❌ Error: could not index document root %s\n", root);
+        return -1;
+    }
+    __atomic_store_n(&doc_index, index, __ATOMIC_RELEASE);
+    LOG(LOG_INFO, " - ✔️ Indexed %zu paths under %s", index->count, root);
+
+    if (inotify_fd >= 0)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, watch_function, NULL) != 0)
+        {
+            LOG(LOG_WARN, " - ⚠️ Warning: could not start the document root watcher");
+            return 0;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+/**
+ * @brief Maps a request path to the file it serves: the file itself, or the
+ *        smallest of its precompressed sidecars the client accepts.
+ *
+ * @param url The request path as sent (not null terminated).
+ * @param len Its length.
+ * @param accepted Encodings the client accepts, one bit (1 << ContentEncoding) each.
+ * @param filepath Receives the file to serve; on a miss, where it would have been (for the log).
+ * @param size Size of filepath.
+ * @param variant Receives the encoding of filepath and whether the response varies (on DOC_FOUND).
+ * @return DOC_FOUND, DOC_MISSING or DOC_INVALID.
+ */
+DocResult docroot_resolve(const char *url, size_t len, unsigned accepted, char *filepath, size_t size,
+                          DocVariant *variant)
+{
+    char normalized[PATH_LEN];
+    int normalized_len = normalize_path(url, len, normalized, sizeof(normalized));
+    if (normalized_len < 0)
+    {
+        snprintf(filepath, size, "invalid_path");
+        return DOC_INVALID;
+    }
+
+    unsigned phase = index_enter();
+    const DocIndex *index = __atomic_load_n(&doc_index, __ATOMIC_ACQUIRE);
+    const DocEntry *entry = find_url(index, normalized, (size_t)normalized_len);
+    if (entry == NULL)
+    {
+        index_leave(phase);
+        snprintf(filepath, size, "%s%s", docroot_path, normalized);
+        return DOC_MISSING;
+    }
+
+    variant->encoding = pick_encoding(entry, accepted);
+    variant->vary = 0;
+    for (int i = 1; i < NUM_ENCODINGS; i++)
+        variant->vary |= entry->variants[i] != NULL;
+    if (variant->encoding != ENCODING_IDENTITY)
+        entry = entry->variants[variant->encoding];
+    variant->size = entry->size;
+
+    size_t fs_len = strlen(entry->fs_path);
+    if (fs_len < size)
+        memcpy(filepath, entry->fs_path, fs_len + 1);
+    index_leave(phase); // nothing of the index is used past here
+    return fs_len < size ? DOC_FOUND : DOC_MISSING;
+}
+
+/**
+ * @brief Puts a request path in the form the index uses: the query and
+ *        fragment are dropped, %XX escapes decoded, repeated slashes merged and
+ *        "." and ".." segments resolved. A path naming a directory ends in a slash.
+ *
+ * @param url The request path (not null terminated).
+ * @param len Its length.
+ * @param out Receives the normalized path, null terminated.
+ * @param size Size of out.
+ * @return Length of the normalized path, or -1 if it is malformed, too long,
+ *         contains a NUL or an escaped slash, or climbs above the root.
+ */
+int normalize_path(const char *url, size_t len, char *out, size_t size)
+{
+    if (len == 0 || url[0] != '/' || size < 2)
+        return -1;
+
+    size_t o = 0;
+    size_t i = 0;
+    int directory = 1; // "/", "/a/", "/a/." and "/a/b/.." all name directories
+    while (i < len && url[i] != '?' && url[i] != '#')
+    {
+        if (url[i] == '/')
+        {
+            i++;
+            directory = 1;
+            continue;
+        }
+
+        // copy one segment after a slash, decoding escapes, then resolve "." and ".."
+        size_t start = o;
+        if (o + 1 >= size)
+            return -1;
+        out[o++] = '/';
+        while (i < len && url[i] != '/' && url[i] != '?' && url[i] != '#')
+        {
+            char c = url[i++];
+            if (c == '%')
+            {
+                int high = i < len ? hex_value(url[i]) : -1;
+                int low = i + 1 < len ? hex_value(url[i + 1]) : -1;
+                if (high < 0 || low < 0)
+                    return -1;
+                c = (char)(high * 16 + low);
+                i += 2;
+            }
+            if (c == '\0' || c == '/' || o + 1 >= size)
+                return -1;
+            out[o++] = c;
+        }
+
+        size_t seg_len = o - start - 1;
+        directory = 0;
+        if (seg_len == 1 && out[start + 1] == '.')
+        {
+            o = start;
+            directory = 1;
+        }
+        else if (seg_len == 2 && out[start + 1] == '.' && out[start + 2] == '.')
+        {
+            if (start == 0)
+                return -1; // would leave the document root
+            o = start;
+            while (out[o - 1] != '/')
+                o--;
+            o--; // drop the parent segment and its slash
+            directory = 1;
+        }
+    }
+
+    if (directory)
+    {
+        if (o + 1 >= size)
+            return -1;
+        out[o++] = '/';
+    }
+    out[o] = '\0';
+    return (int)o;
+}
+
+/**
+ * @brief Watcher thread: waits for changes under the document root, lets a
+ *        burst of them settle, then rebuilds the index and swaps it in.
+ *
+ * @param arg Unused.
+ */
+void *watch_function(void *arg)
+{
+    (void)arg;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (1)
+    {
+        ssize_t n = read(inotify_fd, events, sizeof(events));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        // a copy or an editor's save is many events; wait until they stop coming
+        struct pollfd pfd = {.fd = inotify_fd, .events = POLLIN};
+        while (poll(&pfd, 1, DOCROOT_SETTLE_MS) > 0)
+        {
+            if (read(inotify_fd, events, sizeof(events)) <= 0)
+                break;
+        }
+
+        DocIndex *index = build_index(docroot_path);
+        if (index == NULL)
+        {
+            LOG(LOG_WARN, " - ⚠️ Warning: could not rescan %s, keeping the old index", docroot_path);
+            continue;
+        }
+
+        DocIndex *old = __atomic_exchange_n(&doc_index, index, __ATOMIC_SEQ_CST);
+        wait_for_readers();
+        free_index(old);
+        LOG(LOG_INFO, " - ✔️ Reindexed %zu paths under %s", index->count, docroot_path);
+    }
+
+    LOG(LOG_WARN, " - ⚠️ Warning: document root watcher stopped");
+    return NULL;
+}
+
+/**
+ * @brief Scans a whole document root into a new index, watching every directory
+ *        on the way while the watcher is running. The pack builder uses it too.
+ *
+ * @param root The directory to scan.
+ * @return The index, or NULL if the root cannot be read or memory runs out.
+ */
+DocIndex *build_index(const char *root)
+{
+    DocIndex *index = (DocIndex *)calloc(1, sizeof(DocIndex));
+    char fs_path[PATH_LEN * 2];
+    size_t root_len = strlen(root);
+
+    // the root's own trailing slash would otherwise become part of every URL
+    while (root_len > 1 && root[root_len - 1] == '/')
+        root_len--;
+    if (index == NULL || root_len >= sizeof(fs_path))
+    {
+        free(index);
+        return NULL;
+    }
+    memcpy(fs_path, root, root_len);
+    fs_path[root_len] = '\0';
+
+    if (scan_dir(index, fs_path, root_len, root_len, 0) < 0)
+    {
+        free_index(index);
+        return NULL;
+    }
+    link_variants(index, root_len);
+    return index;
+}
+
+/**
+ * @brief Frees an index and its strings.
+ *
+ * @param index The index (may be NULL).
+ */
+void free_index(DocIndex *index)
+{
+    if (index == NULL)
+        return;
+    for (size_t i = 0; i < index->slots; i++)
+    {
+        free(index->entries[i].url);
+        free(index->entries[i].fs_path);
+    }
+    free(index->entries);
+    free(index);
+}
+
+/**
+ * @brief FNV-1a hash of a URL path, never 0 (0 marks an empty slot).
+ *
+ * @param url The path.
+ * @param len Its length.
+ * @return The hash.
+ */
+uint32_t url_hash(const char *url, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)url[i];
+        hash *= 16777619u;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Counts a lookup in before it loads doc_index. Counting in first and checking
+ *        the phase second means wait_for_readers() either sees the lookup and waits,
+ *        or the lookup starts in the new phase and can only load the new index.
+ *
+ * @return The phase to hand to index_leave().
+ */
+unsigned index_enter()
+{
+    while (1)
+    {
+        unsigned phase = __atomic_load_n(&index_phase, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&index_readers[phase], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&index_phase, __ATOMIC_SEQ_CST) == phase)
+            return phase;
+        index_leave(phase); // the phase flipped under us; count in again in the new one
+    }
+}
+
+/**
+ * @brief Counts a lookup out again once it no longer touches the index.
+ *
+ * @param phase What index_enter() returned.
+ */
+void index_leave(unsigned phase)
+{
+    __atomic_fetch_sub(&index_readers[phase], 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Waits until no lookup that may have loaded the index before the last
+ *        swap is still running. New lookups count themselves in the other phase,
+ *        so this only waits for the few already in flight. Only the watcher calls it.
+ */
+void wait_for_readers()
+{
+    unsigned phase = __atomic_load_n(&index_phase, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&index_phase, phase ^ 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&index_readers[phase], __ATOMIC_ACQUIRE) != 0)
+    {
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Adds every file under one directory to the index, and the directory
+ *        itself if it has an index file.
+ *
+ * @param index The index being built.
+ * @param fs_path Buffer of PATH_LEN * 2 bytes holding the directory's path.
+ * @param fs_len Length of the directory's path.
+ * @param root_len Length of the document root's path; the URL is what follows it.
+ * @param depth How deep below the root the directory is.
+ * @return 0 on success, -1 if the directory cannot be read or memory runs out.
+ */
+int scan_dir(DocIndex *index, char *fs_path, size_t fs_len, size_t root_len, int depth)
+{
+    DIR *dir = opendir(fs_path);
+    if (dir == NULL)
+        return depth == 0 ? -1 : 0; // a subdirectory may vanish while we scan
+    if (inotify_fd >= 0)
+        inotify_add_watch(inotify_fd, fs_path, DOCROOT_WATCH_MASK | IN_ONLYDIR);
+
+    int has_index = 0;
+    struct stat index_st;
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL)
+    {
+        const char *name = dirent->d_name;
+        size_t name_len = strlen(name);
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || fs_len + 1 + name_len >= PATH_LEN * 2)
+            continue;
+
+        fs_path[fs_len] = '/';
+        memcpy(fs_path + fs_len + 1, name, name_len + 1);
+
+        // symlinked files are served, symlinked directories are not followed (no loops)
+        struct stat st;
+        if (lstat(fs_path, &st) < 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+        {
+            if (depth < DOCROOT_MAX_DEPTH &&
+                scan_dir(index, fs_path, fs_len + 1 + name_len, root_len, depth + 1) < 0)
+            {
+                closedir(dir);
+                return -1;
+            }
+            continue;
+        }
+        if (S_ISLNK(st.st_mode) && stat(fs_path, &st) < 0)
+            continue;
+        if (!S_ISREG(st.st_mode))
+            continue;
+
+        if (add_entry(index, fs_path + root_len, fs_len + 1 + name_len - root_len, fs_path, &st) < 0)
+        {
+            closedir(dir);
+            return -1;
+        }
+        if (strcmp(name, DOCROOT_INDEX_FILE) == 0)
+        {
+            has_index = 1;
+            index_st = st;
+        }
+    }
+    closedir(dir);
+
+    // "/docs/" and "/docs" serve docs/index.html ("/" the root's)
+    if (has_index)
+    {
+        char url[PATH_LEN * 2];
+        size_t url_len = fs_len - root_len;
+        memcpy(url, fs_path + root_len, url_len);
+        snprintf(fs_path + fs_len, PATH_LEN * 2 - fs_len, "/%s", DOCROOT_INDEX_FILE);
+
+        url[url_len] = '/';
+        if (add_entry(index, url, url_len + 1, fs_path, &index_st) < 0 ||
+            (url_len > 0 && add_entry(index, url, url_len, fs_path, &index_st) < 0))
+            return -1;
+    }
+    fs_path[fs_len] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Adds a URL to the index, doubling the table when it is half full.
+ *
+ * @param index The index.
+ * @param url The URL path (not null terminated).
+ * @param url_len Its length.
+ * @param fs_path The file it serves.
+ * @param st The file's metadata.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int add_entry(DocIndex *index, const char *url, size_t url_len, const char *fs_path, const struct stat *st)
+{
+    if (2 * (index->count + 1) > index->slots)
+    {
+        size_t slots = index->slots ? index->slots * 2 : DOCROOT_MIN_SLOTS;
+        DocEntry *entries = (DocEntry *)calloc(slots, sizeof(DocEntry));
+        if (entries == NULL)
+            return -1;
+
+        for (size_t i = 0; i < index->slots; i++)
+        {
+            if (index->entries[i].hash == 0)
+                continue;
+            size_t slot = index->entries[i].hash & (slots - 1);
+            while (entries[slot].hash != 0)
+                slot = (slot + 1) & (slots - 1);
+            entries[slot] = index->entries[i];
+        }
+        free(index->entries);
+        index->entries = entries;
+        index->slots = slots;
+    }
+
+    uint32_t hash = url_hash(url, url_len);
+    size_t slot = hash & (index->slots - 1);
+    while (index->entries[slot].hash != 0)
+        slot = (slot + 1) & (index->slots - 1);
+
+    DocEntry *entry = &index->entries[slot];
+    entry->url = strndup(url, url_len);
+    entry->fs_path = strdup(fs_path);
+    if (entry->url == NULL || entry->fs_path == NULL)
+    {
+        free(entry->url);
+        free(entry->fs_path);
+        entry->url = entry->fs_path = NULL;
+        return -1;
+    }
+    entry->hash = hash;
+    entry->size = (size_t)st->st_size;
+    entry->mtime = st->st_mtim;
+    index->count++;
+    return 0;
+}
+
+/**
+ * @brief Looks up a normalized URL path.
+ *
+ * @param index The index.
+ * @param url The path.
+ * @param len Its length.
+ * @return The entry, or NULL if the path is not servable.
+ */
+const DocEntry *find_url(const DocIndex *index, const char *url, size_t len)
+{
+    if (index->slots == 0)
+        return NULL;
+
+    uint32_t hash = url_hash(url, len);
+    for (size_t slot = hash & (index->slots - 1); index->entries[slot].hash != 0;
+         slot = (slot + 1) & (index->slots - 1))
+    {
+        const DocEntry *entry = &index->entries[slot];
+        if (entry->hash == hash && strncmp(entry->url, url, len) == 0 && entry->url[len] == '\0')
+            return entry;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Links every entry to its precompressed sidecars ("/site.css" to
+ *        "/site.css.gz" and so on). A sidecar only counts if it is smaller than
+ *        the file and not older, so a stale one is never served in its place.
+ *        Runs once the scan is done, so the entries no longer move.
+ *
+ * @param index The finished index.
+ * @param root_len Length of the document root's path; a file's URL is what follows it.
+ */
+void link_variants(DocIndex *index, size_t root_len)
+{
+    char url[PATH_LEN * 2];
+    for (size_t i = 0; i < index->slots; i++)
+    {
+        DocEntry *entry = &index->entries[i];
+        if (entry->hash == 0)
+            continue;
+
+        // a directory's URL shares the sidecars of its index file, so go by the file's own URL
+        size_t url_len = strlen(entry->fs_path + root_len);
+        if (url_len + 8 >= sizeof(url))
+            continue;
+        memcpy(url, entry->fs_path + root_len, url_len);
+        for (int encoding = 1; encoding < NUM_ENCODINGS; encoding++)
+        {
+            size_t suffix_len = strlen(encoding_suffixes[encoding]);
+            memcpy(url + url_len, encoding_suffixes[encoding], suffix_len + 1);
+
+            const DocEntry *sidecar = find_url(index, url, url_len + suffix_len);
+            if (sidecar != NULL && sidecar->size < entry->size &&
+                (sidecar->mtime.tv_sec > entry->mtime.tv_sec ||
+                 (sidecar->mtime.tv_sec == entry->mtime.tv_sec && sidecar->mtime.tv_nsec >= entry->mtime.tv_nsec)))
+                entry->variants[encoding] = sidecar;
+        }
+    }
+}
+
+/**
+ * @brief Picks the smallest representation of a file the client accepts.
+ *
+ * @param entry The file's entry.
+ * @param accepted Encodings the client accepts, one bit (1 << ContentEncoding) each.
+ * @return The encoding to send, ENCODING_IDENTITY for the file itself.
+ */
+ContentEncoding pick_encoding(const DocEntry *entry, unsigned accepted)
+{
+    ContentEncoding best = ENCODING_IDENTITY;
+    size_t best_size = entry->size;
+    for (int encoding = 1; encoding < NUM_ENCODINGS; encoding++)
+    {
+        const DocEntry *sidecar = entry->variants[encoding];
+        if ((accepted & (1u << encoding)) && sidecar != NULL && sidecar->size < best_size)
+        {
+            best = (ContentEncoding)encoding;
+            best_size = sidecar->size;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Value of a hex digit.
+ *
+ * @param c The character.
+ * @return 0 to 15, or -1 if c is not a hex digit.
+ */
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
@@ -0,0 +1,77 @@
+/**
+ * Summary: Header file for the document root index: every servable URL path, found by scanning
+ *          the document root at startup and kept current with inotify, so resolving a request
+ *          path needs no syscall.
+ *
+ * @file docroot.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef DOCROOT_H
+#define DOCROOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define DEFAULT_DOCROOT "server-side/www" // directory served (-r)
+#define DOCROOT_INDEX_FILE "index.html"   // served for a directory's URL
+#define DOCROOT_MAX_DEPTH 32              // deepest subdirectory indexed
+#define DOCROOT_SETTLE_MS 100             // quiet time after a change before the index is rebuilt
+
+// what a request path resolved to
+typedef enum DocResult
+{
+    DOC_INVALID = -1, // malformed, or escapes the document root (400)
+    DOC_MISSING = 0,  // well formed but not in the index (404)
+    DOC_FOUND = 1
+} DocResult;
+
+// encodings a file may also be stored in, as a precompressed sidecar next to it ("site.css.gz")
+typedef enum ContentEncoding
+{
+    ENCODING_IDENTITY = 0, // the file itself
+    ENCODING_GZIP,
+    ENCODING_ZSTD,
+    ENCODING_BR,
+    NUM_ENCODINGS
+} ContentEncoding;
+
+// one servable URL path
+typedef struct DocEntry
+{
+    uint32_t hash; // 0 = empty slot
+    char *url;     // normalized, e.g. "/css/site.css", or "/docs/" for a directory's index file
+    char *fs_path; // file to serve, e.g. "server-side/www/css/site.css"
+    size_t size;
+    struct timespec mtime;
+    const struct DocEntry *variants[NUM_ENCODINGS]; // up-to-date, smaller sidecars by encoding (NULL = none)
+} DocEntry;
+
+// which representation of a file a request gets
+typedef struct DocVariant
+{
+    ContentEncoding encoding; // how the file in filepath is encoded
+    int vary;                 // the file has sidecars, so the response depends on Accept-Encoding
+    size_t size;              // size of the file in filepath when it was indexed
+} DocVariant;
+
+// open addressing table of every URL; replaced as a whole when the tree changes
+typedef struct DocIndex
+{
+    DocEntry *entries;
+    size_t slots; // power of two
+    size_t count;
+} DocIndex;
+
+int docroot_init(const char *root);
+DocResult docroot_resolve(const char *url, size_t len, unsigned accepted, char *filepath, size_t size,
+                          DocVariant *variant);
+int normalize_path(const char *url, size_t len, char *out, size_t size);
+DocIndex *build_index(const char *root);
+void free_index(DocIndex *index);
+uint32_t url_hash(const char *url, size_t len);
+
+extern const char *const encoding_names[NUM_ENCODINGS];    // Content-Encoding tokens ("" for identity)
+extern const char *const encoding_suffixes[NUM_ENCODINGS]; // sidecar file extensions
+
+#endif
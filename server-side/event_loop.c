@@ -0,0 +1,563 @@
+/**
+ * Summary: Implementation of the edge-triggered epoll reactor. It accepts clients, buffers their
+ *          requests without blocking, hands complete requests to the thread pool and flushes the
+ *          responses the workers hand back. The io_uring backend plugs in through the same
+ *          connection_received()/flush_connection() hooks.
+ *
+ * @file event_loop.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE // accept4()
+
+#include "event_loop.h"
+#include "http_parser.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include "uring_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// --- FUNCTION DECLERATIONS ---
+int event_loop_init(EventLoop *loop, int listenfd, ThreadPool *pool, int use_io_uring);
+void event_loop_run(EventLoop *loop);
+void event_loop_return(Connection *conn);
+void connection_received(EventLoop *loop, Connection *conn);
+void flush_connection(EventLoop *loop, Connection *conn);
+void drain_returned(EventLoop *loop);
+void drain_backlog(EventLoop *loop);
+void connection_done(EventLoop *loop, Connection *conn);
+void idle_untrack(EventLoop *loop, Connection *conn);
+void sweep_idle(EventLoop *loop);
+void idle_track(EventLoop *loop, Connection *conn, IdleList list);
+time_t now_seconds();
+int epoll_setup(EventLoop *loop);
+void accept_connections(EventLoop *loop);
+void handle_readable(EventLoop *loop, Connection *conn);
+void wait_readable(EventLoop *loop, Connection *conn);
+int arm_connection(EventLoop *loop, Connection *conn, uint32_t events);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Sets up the event loop on io_uring when asked for and supported,
+ *        otherwise on epoll.
+ *
+ * @param loop The event loop to initialize.
+ * @param listenfd The listening socket; it is switched to non-blocking mode here.
+ * @param pool The thread pool complete requests are handed to.
+ * @param use_io_uring Non-zero to try the io_uring backend first.
+ * @return 0 on success, -1 on failure.
+ */
+int event_loop_init(EventLoop *loop, int listenfd, ThreadPool *pool, int use_io_uring)
+{
+    loop->listenfd = listenfd;
+    loop->pool = pool;
+    loop->epfd = -1;
+    loop->uring = NULL;
+    loop->return_head = NULL;
+    loop->backlog_head = NULL;
+    loop->backlog_tail = NULL;
+    for (int i = 0; i < NUM_IDLE_LISTS; i++)
+    {
+        loop->idle_head[i] = NULL;
+        loop->idle_tail[i] = NULL;
+    }
+    pthread_mutex_init(&loop->return_mutex, NULL);
+
+    int flags = fcntl(listenfd, F_GETFL, 0);
+    if (flags < 0 || fcntl(listenfd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        perror(" - ❌ Error: could not make welcome socket non-blocking");
+        return -1;
+    }
+
+    loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wakefd < 0)
+    {
+        perror(" - ❌ Error: eventfd failed");
+        return -1;
+    }
+
+    if (use_io_uring)
+    {
+        if (uring_loop_init(loop) == 0)
+        {
+            LOG(LOG_INFO, " - ✔️ Using io_uring I/O backend");
+            return 0;
+        }
+        LOG(LOG_WARN, " - ⚠️ Warning: io_uring unavailable, falling back to epoll");
+    }
+    return epoll_setup(loop);
+}
+
+/**
+ * @brief Runs the reactor forever: accept, read until a request is complete,
+ *        enqueue it, and flush responses handed back by the workers.
+ *
+ * @param loop The initialized event loop.
+ */
+void event_loop_run(EventLoop *loop)
+{
+    if (loop->uring != NULL)
+    {
+        uring_loop_run(loop);
+        return;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    time_t last_sweep = now_seconds();
+
+    while (1)
+    {
+        // wake up at least once per sweep interval to close idle keep-alive connections
+        int n = epoll_wait(loop->epfd, events, MAX_EVENTS, SWEEP_INTERVAL_MS);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror(" - ❌ Error: epoll_wait failed");
+            return;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            void *tag = events[i].data.ptr;
+
+            if (tag == NULL)
+            {
+                accept_connections(loop);
+            }
+            else if (tag == loop)
+            {
+                drain_returned(loop);
+            }
+            else
+            {
+                Connection *conn = (Connection *)tag;
+                if (conn->state == CONN_READING)
+                {
+                    handle_readable(loop, conn);
+                }
+                else if (conn->state == CONN_WRITING)
+                {
+                    flush_connection(loop, conn);
+                }
+            }
+        }
+
+        if (now_seconds() != last_sweep)
+        {
+            sweep_idle(loop);
+            last_sweep = now_seconds();
+        }
+    }
+}
+
+/**
+ * @brief Hands a connection whose response has been built back to its event loop.
+ *        Called from worker threads; the loop does the actual socket writes.
+ *
+ * @param conn The connection the worker is done with.
+ */
+void event_loop_return(Connection *conn)
+{
+    EventLoop *loop = conn->loop;
+
+    pthread_mutex_lock(&loop->return_mutex);
+    conn->next = loop->return_head;
+    loop->return_head = conn;
+    pthread_mutex_unlock(&loop->return_mutex);
+
+    uint64_t one = 1;
+    if (write(loop->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        perror(" - ❌ Error: could not wake event loop");
+    }
+}
+
+/**
+ * @brief Decides what to do after new request bytes were buffered: hand a complete
+ *        request to the thread pool, reject an oversized one, or wait for more.
+ *        A complete request that finds every worker queue full (or others already
+ *        waiting) joins the loop's backlog instead of being dropped.
+ *
+ * @param loop The event loop that owns the connection.
+ * @param conn The connection that just received data.
+ */
+void connection_received(EventLoop *loop, Connection *conn)
+{
+    if (request_ready(conn))
+    {
+        idle_untrack(loop, conn);
+        conn->state = CONN_PROCESSING;
+        conn->enqueued_ns = monotonic_ns(); // time held in the backlog counts as queue wait
+        if (loop->backlog_head == NULL && enqueue(loop->pool, conn) == 0)
+            return; // a worker owns it from here on
+
+        conn->next = NULL;
+        if (loop->backlog_tail)
+            loop->backlog_tail->next = conn;
+        else
+            loop->backlog_head = conn;
+        loop->backlog_tail = conn;
+        return;
+    }
+
+    if (conn->peer_closed)
+    {
+        conn_destroy(conn); // client left before finishing its request
+    }
+    else if (conn->in_len >= CONN_BUFFER_SIZE - 1)
+    {
+        conn->keep_alive = 0;
+        send_error_response("Request Too Large", conn, 400);
+        flush_connection(loop, conn);
+    }
+    else
+    {
+        wait_readable(loop, conn);
+    }
+}
+
+/**
+ * @brief Writes the pending response. If the socket fills up we wait for
+ *        write-readiness, otherwise the response is finished. A response the
+ *        worker could only queue in part is not sent at all; the connection is closed.
+ *
+ * @param loop The event loop that owns the connection.
+ * @param conn The connection with a response to send.
+ */
+void flush_connection(EventLoop *loop, Connection *conn)
+{
+    if (conn->failed)
+    {
+        conn_destroy(conn);
+        return;
+    }
+
+    conn->state = CONN_WRITING;
+    idle_track(loop, conn, IDLE_WRITE); // on epoll every call follows progress, so restamp
+
+    if (loop->uring != NULL)
+    {
+        uring_submit_write(loop, conn);
+        return;
+    }
+
+    int status = conn_flush(conn);
+    if (status == 1)
+    {
+        connection_done(loop, conn);
+    }
+    else if (status < 0 || arm_connection(loop, conn, EPOLLOUT) < 0)
+    {
+        conn_destroy(conn);
+    }
+    // otherwise resume when the socket drains
+}
+
+/**
+ * @brief Takes every connection the workers handed back and starts flushing it.
+ *        Each one means a worker took something off a queue, so the backlog is
+ *        retried first.
+ *
+ * @param loop The event loop being woken up.
+ */
+void drain_returned(EventLoop *loop)
+{
+    uint64_t count;
+    if (read(loop->wakefd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        perror(" - ❌ Error: could not read wakeup eventfd");
+    }
+
+    drain_backlog(loop);
+
+    pthread_mutex_lock(&loop->return_mutex);
+    Connection *conn = loop->return_head;
+    loop->return_head = NULL;
+    pthread_mutex_unlock(&loop->return_mutex);
+
+    while (conn != NULL)
+    {
+        Connection *next = conn->next;
+        conn->next = NULL;
+        flush_connection(loop, conn);
+        conn = next;
+    }
+}
+
+/**
+ * @brief Hands backlogged connections to the workers, oldest first, until the
+ *        queues are full again.
+ *
+ * @param loop The event loop whose backlog is retried.
+ */
+void drain_backlog(EventLoop *loop)
+{
+    while (loop->backlog_head != NULL)
+    {
+        // a worker owns the connection (and its link) as soon as it is enqueued
+        Connection *next = loop->backlog_head->next;
+        if (enqueue(loop->pool, loop->backlog_head) < 0)
+            return;
+        loop->backlog_head = next;
+        if (next == NULL)
+            loop->backlog_tail = NULL;
+    }
+}
+
+/**
+ * @brief Called once a response has been fully sent. Persistent connections go back
+ *        to reading (serving any request already buffered), the rest are closed.
+ *
+ * @param loop The event loop that owns the connection.
+ * @param conn The connection whose response is out.
+ */
+void connection_done(EventLoop *loop, Connection *conn)
+{
+    if (!conn->keep_alive)
+    {
+        conn_destroy(conn);
+        return;
+    }
+
+    conn->state = CONN_READING;
+    connection_received(loop, conn);
+}
+
+/**
+ * @brief Removes a connection from the timeout list it is on, if any.
+ *
+ * @param loop The event loop that owns the connection.
+ * @param conn The connection that is no longer waiting on the client.
+ */
+void idle_untrack(EventLoop *loop, Connection *conn)
+{
+    if (conn->idle_list < 0)
+        return;
+
+    int list = conn->idle_list;
+    if (conn->idle_prev)
+        conn->idle_prev->idle_next = conn->idle_next;
+    else
+        loop->idle_head[list] = conn->idle_next;
+
+    if (conn->idle_next)
+        conn->idle_next->idle_prev = conn->idle_prev;
+    else
+        loop->idle_tail[list] = conn->idle_prev;
+
+    conn->idle_prev = NULL;
+    conn->idle_next = NULL;
+    conn->idle_list = -1;
+}
+
+/**
+ * @brief Closes every connection that has waited on its client longer than the
+ *        timeout of its list. Each list is ordered by when the wait started, so we
+ *        stop at the first connection that is still fresh.
+ *
+ * @param loop The event loop to sweep.
+ */
+void sweep_idle(EventLoop *loop)
+{
+    static const int timeouts[NUM_IDLE_LISTS] = {KEEPALIVE_TIMEOUT, REQUEST_TIMEOUT, WRITE_TIMEOUT};
+    time_t now = now_seconds();
+
+    for (int list = 0; list < NUM_IDLE_LISTS; list++)
+    {
+        while (loop->idle_head[list] != NULL && now - loop->idle_head[list]->last_active >= timeouts[list])
+        {
+            Connection *conn = loop->idle_head[list];
+            idle_untrack(loop, conn);
+
+            if (loop->uring != NULL)
+            {
+                // a receive or send is still in the kernel; shutting down completes it
+                // and the normal completion path closes the connection
+                shutdown(conn->fd, SHUT_RDWR);
+            }
+            else
+            {
+                conn_destroy(conn);
+            }
+        }
+    }
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Puts a connection at the back of a timeout list, stamped with the current time.
+ *
+ * @param loop The event loop that owns the connection.
+ * @param conn The connection now waiting on its client.
+ * @param list What it is waiting for.
+ */
+void idle_track(EventLoop *loop, Connection *conn, IdleList list)
+{
+    idle_untrack(loop, conn);
+
+    conn->last_active = now_seconds();
+    conn->idle_prev = loop->idle_tail[list];
+    conn->idle_next = NULL;
+    if (loop->idle_tail[list])
+        loop->idle_tail[list]->idle_next = conn;
+    else
+        loop->idle_head[list] = conn;
+    loop->idle_tail[list] = conn;
+    conn->idle_list = list;
+}
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return Seconds since an arbitrary fixed point.
+ */
+time_t now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/**
+ * @brief Creates the epoll instance and registers the welcome socket and wakeup eventfd.
+ *
+ * @param loop The event loop to set up.
+ * @return 0 on success, -1 on failure.
+ */
+int epoll_setup(EventLoop *loop)
+{
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0)
+    {
+        perror(" - ❌ Error: epoll_create1 failed");
+        return -1;
+    }
+
+    // the welcome socket is tagged with NULL and the eventfd with the loop itself,
+    // every other registered pointer is a Connection
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLET, .data.ptr = NULL};
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->listenfd, &ev) < 0)
+    {
+        perror(" - ❌ Error: could not watch welcome socket");
+        return -1;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = loop;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakefd, &ev) < 0)
+    {
+        perror(" - ❌ Error: could not watch wakeup eventfd");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Accepts every pending client on the welcome socket.
+ *        The socket is edge-triggered, so we keep going until accept() would block.
+ *
+ * @param loop The event loop that will own the new connections.
+ */
+void accept_connections(EventLoop *loop)
+{
+    while (1)
+    {
+        int clientfd = accept4(loop->listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientfd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG(LOG_ERROR, " - ❌ Error: accept() failed");
+            return;
+        }
+
+        Connection *conn = conn_create(clientfd, loop);
+        if (conn == NULL)
+        {
+            close(clientfd);
+            continue;
+        }
+
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT,
+                                 .data.ptr = conn};
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, clientfd, &ev) < 0)
+        {
+            perror(" - ❌ Error: could not watch client socket");
+            conn_destroy(conn);
+            continue;
+        }
+        idle_track(loop, conn, IDLE_KEEPALIVE); // a client that never sends anything still times out
+    }
+}
+
+/**
+ * @brief Reads whatever the client has sent. Once a full request is buffered the
+ *        connection is given to the thread pool, otherwise we wait for more bytes.
+ *
+ * @param loop The event loop that owns the connection.
+ * @param conn The readable connection.
+ */
+void handle_readable(EventLoop *loop, Connection *conn)
+{
+    if (receive_message(conn) < 0)
+    {
+        conn_destroy(conn);
+        return;
+    }
+    connection_received(loop, conn);
+}
+
+/**
+ * @brief Waits for the client to send more request bytes. The timeout runs from
+ *        the start of the wait, so later partial reads of the same request do not
+ *        extend it.
+ *
+ * @param loop The event loop that owns the connection.
+ * @param conn The connection to read from next.
+ */
+void wait_readable(EventLoop *loop, Connection *conn)
+{
+    IdleList list = conn->in_len > 0 ? IDLE_REQUEST : IDLE_KEEPALIVE;
+    if (conn->idle_list != (int)list)
+        idle_track(loop, conn, list);
+
+    if (loop->uring != NULL)
+    {
+        uring_submit_recv(loop, conn);
+    }
+    else if (arm_connection(loop, conn, EPOLLIN) < 0)
+    {
+        conn_destroy(conn);
+    }
+}
+
+/**
+ * @brief Re-arms a one-shot connection for the next readiness event.
+ *
+ * @param loop The event loop that owns the connection.
+ * @param conn The connection to watch.
+ * @param events EPOLLIN to wait for request bytes or EPOLLOUT to wait for send space.
+ * @return 0 on success, -1 on failure.
+ */
+int arm_connection(EventLoop *loop, Connection *conn, uint32_t events)
+{
+    struct epoll_event ev = {.events = events | EPOLLRDHUP | EPOLLET | EPOLLONESHOT,
+                             .data.ptr = conn};
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, conn->fd, &ev) < 0)
+    {
+        perror(" - ❌ Error: could not re-arm client socket");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * Summary: Header file defining the epoll event loop that owns accepting, reading and writing client sockets.
+ *
+ * @file event_loop.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "connection.h"
+#include "thread_pool.h"
+
+#include <pthread.h>
+
+#define MAX_EVENTS 64       // epoll events handled per wakeup
+#define SWEEP_INTERVAL_MS 1000 // how often the timeout lists are checked
+
+struct UringLoop;
+
+// what a connection owned by the loop is waiting on; each wait has its own timeout
+typedef enum IdleList
+{
+    IDLE_KEEPALIVE, // the next request, KEEPALIVE_TIMEOUT from the end of the last response
+    IDLE_REQUEST,   // the rest of a started request, REQUEST_TIMEOUT from its first bytes
+    IDLE_WRITE,     // send space for a response, WRITE_TIMEOUT from the last progress
+    NUM_IDLE_LISTS
+} IdleList;
+
+typedef struct EventLoop
+{
+    int epfd;                // epoll instance (-1 when running on io_uring)
+    struct UringLoop *uring; // io_uring backend, NULL when running on epoll
+    int listenfd;            // non-blocking welcome socket
+    int wakefd;              // eventfd workers poke when they hand a connection back
+    ThreadPool *pool;        // workers that build responses for this loop's connections
+
+    // connections whose response is ready, handed back by the workers
+    pthread_mutex_t return_mutex;
+    Connection *return_head;
+
+    // connections with a complete request that found every worker queue full, oldest first;
+    // they are not read from until a worker takes them
+    Connection *backlog_head;
+    Connection *backlog_tail;
+
+    // connections waiting on the client, one list per IdleList, longest waiting first
+    Connection *idle_head[NUM_IDLE_LISTS];
+    Connection *idle_tail[NUM_IDLE_LISTS];
+} EventLoop;
+
+int event_loop_init(EventLoop *loop, int listenfd, ThreadPool *pool, int use_io_uring);
+void event_loop_run(EventLoop *loop);
+void event_loop_return(Connection *conn);
+void connection_received(EventLoop *loop, Connection *conn);
+void flush_connection(EventLoop *loop, Connection *conn);
+void drain_returned(EventLoop *loop);
+void drain_backlog(EventLoop *loop);
+void connection_done(EventLoop *loop, Connection *conn);
+void wait_readable(EventLoop *loop, Connection *conn);
+void idle_untrack(EventLoop *loop, Connection *conn);
+void idle_track(EventLoop *loop, Connection *conn, IdleList list);
+void sweep_idle(EventLoop *loop);
+
+#endif
@@ -0,0 +1,574 @@
+/**
+ * Summary: Static file cache. Files up to FILE_CACHE_MAX_FILE are read into memory once; larger
+ *          ones are kept open, so they are still sent with sendfile() but without the path walk,
+ *          stat() and open() of every request. Either way the entry carries the file's metadata
+ *          (size, mtime, MIME type, ETag) and its "200 OK" status line with File-Name,
+ *          Content-Length, Content-Type, ETag and Last-Modified headers, so a hit costs a hash lookup and goes out with
+ *          no formatting. The cache is split into shards with their own lock, each bounded in
+ *          bytes held in memory, open fds and entries, evicting with the CLOCK algorithm. Entries
+ *          are reference counted, so one evicted or replaced while a response still sends it
+ *          (from memory or its fd) lives until that response is done. A hit older than
+ *          FILE_CACHE_REVALIDATE_MS is checked with stat() and reloaded if the file changed.
+ *          A precompressed sidecar is cached under its own path and encoding, with the header
+ *          of the file it stands in for plus Content-Encoding. A text file without a gzip
+ *          sidecar gets one made here (compress.c), cached under the file's path and gzip and
+ *          revalidated against the file; misses are single-flight, so concurrent requests for
+ *          a new or changed file read and compress it once.
+ *
+ * @file file_cache.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE // asprintf()
+
+#include "file_cache.h"
+#include "compress.h"
+#include "http_parser.h" // get_mime_type()
+#include "server.h"      // PATH_LEN
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a miss being loaded by one thread; others asking for the same file wait for it
+typedef struct PendingLoad
+{
+    const char *path;
+    ContentEncoding encoding;
+    uint32_t hash;
+    struct PendingLoad *next;
+} PendingLoad;
+
+// one independently locked part of the cache
+typedef struct CacheShard
+{
+    pthread_mutex_t mutex;
+    CachedFile *buckets[FILE_CACHE_SLOTS];
+    CachedFile *clock[FILE_CACHE_SLOTS]; // entries in clock order, NULL = free slot
+    int hand;
+    int count;
+    size_t used; // file bytes held in memory by the entries
+    int fds;     // entries holding an open fd
+    struct PendingLoad *pending; // files being read right now
+    pthread_cond_t loaded;       // signalled whenever one of them is done
+} CacheShard;
+
+// --- FILE CACHE GLOBALS ---
+CacheShard cache_shards[FILE_CACHE_SHARDS];
+size_t shard_budget = 0; // file bytes each shard may hold in memory
+int shard_fd_limit = 0;  // open fds each shard may hold
+
+// --- FUNCTION DECLERATIONS ---
+int file_cache_init(size_t budget, int max_fds);
+CachedFile *file_cache_get(const char *path, ContentEncoding encoding);
+void file_cache_release(void *file);
+int file_header(const char *path, const struct stat *st, size_t size, ContentEncoding encoding, char **header);
+int file_etag(const char *path, const struct stat *st, ContentEncoding encoding, char *etag, size_t size);
+
+// --- HELPER FUNCTIONS ---
+CachedFile *load_file(const char *path, ContentEncoding encoding, uint32_t hash, uint64_t now_ms);
+int still_fresh(CachedFile *entry);
+CachedFile *find_entry(CacheShard *shard, const char *path, ContentEncoding encoding, uint32_t hash);
+int is_pending(CacheShard *shard, const char *path, ContentEncoding encoding, uint32_t hash);
+int is_sidecar(const char *path, ContentEncoding encoding);
+int insert_entry(CacheShard *shard, CachedFile *entry);
+void remove_entry(CacheShard *shard, CachedFile *entry);
+int evict_one(CacheShard *shard, int need_fd);
+uint32_t cache_hash(const char *path);
+uint64_t coarse_ms();
+
+// --- FUNCTIONS ---
+/**
+ * @brief Sets up the cache shards. With both limits at 0 the cache is off.
+ *
+ * @param budget Bytes of small files the whole cache may hold in memory.
+ * @param max_fds Open files the whole cache may hold for large files.
+ * @return 0 on success, -1 on failure.
+ */
+int file_cache_init(size_t budget, int max_fds)
+{
+    for (int i = 0; i < FILE_CACHE_SHARDS; i++)
+    {
+        if (pthread_mutex_init(&cache_shards[i].mutex, NULL) != 0 ||
+            pthread_cond_init(&cache_shards[i].loaded, NULL) != 0)
+            return -1;
+    }
+    shard_budget = budget / FILE_CACHE_SHARDS;
+    shard_fd_limit = (max_fds + FILE_CACHE_SHARDS - 1) / FILE_CACHE_SHARDS;
+    return 0;
+}
+
+/**
+ * @brief Looks up a file, reading it into the cache on a miss. Misses are
+ *        single-flight: while one thread reads (or compresses) a file, others
+ *        asking for it wait for that result instead of repeating the work.
+ *
+ * @param path The resolved file path.
+ * @param encoding The encoding it is sent with: ENCODING_IDENTITY, a sidecar's
+ *        encoding, or ENCODING_GZIP for a file without one, compressed here.
+ * @return The entry with a reference held for the caller (drop it with
+ *         file_cache_release()), or NULL if the cache is off, the file is
+ *         missing or not a regular file, the cache has no room of its kind, or
+ *         compressing the file did not pay off.
+ */
+CachedFile *file_cache_get(const char *path, ContentEncoding encoding)
+{
+    if (shard_budget == 0 && shard_fd_limit == 0)
+        return NULL;
+
+    uint32_t hash = cache_hash(path) + (uint32_t)encoding;
+    CacheShard *shard = &cache_shards[hash % FILE_CACHE_SHARDS];
+    uint64_t now_ms = coarse_ms();
+
+    pthread_mutex_lock(&shard->mutex);
+    CachedFile *entry;
+    while (1)
+    {
+        entry = find_entry(shard, path, encoding, hash);
+        if (entry != NULL && now_ms - entry->checked_ms >= FILE_CACHE_REVALIDATE_MS)
+        {
+            // one stat() per entry per interval, under the lock so only one thread does it
+            if (still_fresh(entry))
+            {
+                entry->checked_ms = now_ms;
+            }
+            else
+            {
+                remove_entry(shard, entry);
+                entry = NULL;
+            }
+        }
+        if (entry != NULL || !is_pending(shard, path, encoding, hash))
+            break;
+        pthread_cond_wait(&shard->loaded, &shard->mutex);
+    }
+    if (entry != NULL)
+    {
+        entry->referenced = 1;
+        if (entry->incompressible)
+            entry = NULL; // remembered, so the file is not deflated again on every request
+        else
+            __atomic_fetch_add(&entry->refs, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&shard->mutex);
+        return entry;
+    }
+
+    // read the file without holding the lock, so hits on the shard are not held up
+    PendingLoad pending = {path, encoding, hash, shard->pending};
+    shard->pending = &pending;
+    pthread_mutex_unlock(&shard->mutex);
+
+    entry = load_file(path, encoding, hash, now_ms);
+
+    pthread_mutex_lock(&shard->mutex);
+    PendingLoad **link = &shard->pending;
+    while (*link != &pending)
+        link = &(*link)->next;
+    *link = pending.next;
+    pthread_cond_broadcast(&shard->loaded);
+
+    if (entry != NULL && insert_entry(shard, entry) == 0)
+        __atomic_fetch_add(&entry->refs, 1, __ATOMIC_RELAXED); // the cache's reference
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (entry != NULL && entry->incompressible)
+    {
+        file_cache_release(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+/**
+ * @brief Drops a reference, freeing the entry when it was the last one.
+ *        Matches the release callback of conn_attach_memory().
+ *
+ * @param file The CachedFile.
+ */
+void file_cache_release(void *file)
+{
+    CachedFile *entry = (CachedFile *)file;
+    if (__atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    if (entry->fd >= 0)
+        close(entry->fd);
+    free(entry->path);
+    free(entry->header);
+    free(entry->body);
+    free(entry);
+}
+
+/**
+ * @brief Formats the response header prepared for a whole file: the status
+ *        line with File-Name, Content-Length, Content-Type, ETag, Last-Modified
+ *        and Accept-Ranges (byte ranges are served of the file itself, not of
+ *        an encoded variant), each ending in "\r\n". Connection headers and the blank
+ *        line follow per response. Shared with the pack builder, so packed and
+ *        cached files answer alike.
+ *
+ * @param path The file path.
+ * @param st The file's metadata, for its validators.
+ * @param size The size of the body as sent (the compressed size for a variant compressed here).
+ * @param encoding The encoding the body is sent with, added as Content-Encoding.
+ *        For a sidecar the name and type are those of the file without the
+ *        sidecar's extension.
+ * @param header Receives the header, allocated (NULL on failure).
+ * @return Length of the header, or -1 on allocation failure.
+ */
+int file_header(const char *path, const struct stat *st, size_t size, ContentEncoding encoding, char **header)
+{
+    // "site.css.gz" stands in for "site.css"
+    char plain[PATH_LEN * 2];
+    size_t path_len = strlen(path);
+    if (is_sidecar(path, encoding))
+        path_len -= strlen(encoding_suffixes[encoding]);
+    snprintf(plain, sizeof(plain), "%.*s", (int)path_len, path);
+
+    const char *file_name = strrchr(plain, '/');
+    file_name = file_name ? file_name + 1 : plain;
+
+    char etag[FILE_CACHE_ETAG_LEN];
+    char modified[HTTP_DATE_LEN];
+    file_etag(path, st, encoding, etag, sizeof(etag));
+    http_date(st->st_mtim.tv_sec, modified, sizeof(modified));
+
+    int header_len = asprintf(header, "HTTP/1.1 200 OK\r\n"
+                                      "File-Name: %s\r\n"
+                                      "Content-Length: %zu\r\n"
+                                      "Content-Type: %s\r\n"
+                                      "ETag: %s\r\n"
+                                      "Last-Modified: %s\r\n"
+                                      "%s%s%s%s",
+                              file_name, size, get_mime_type(plain), etag, modified,
+                              encoding == ENCODING_IDENTITY ? "Accept-Ranges: bytes\r\n" : "",
+                              encoding != ENCODING_IDENTITY ? "Content-Encoding: " : "",
+                              encoding_names[encoding], encoding != ENCODING_IDENTITY ? "\r\n" : "");
+    if (header_len < 0)
+        *header = NULL; // asprintf() leaves it undefined on failure
+    return header_len;
+}
+
+/**
+ * @brief Formats a file's strong ETag from its inode, size and mtime, so it
+ *        changes whenever the file is modified or replaced. A variant compressed
+ *        here is a different representation and gets the encoding appended.
+ *
+ * @param path The file path.
+ * @param st The file's metadata.
+ * @param encoding The encoding the body is sent with.
+ * @param etag Receives the ETag, quoted.
+ * @param size Size of etag (FILE_CACHE_ETAG_LEN is enough).
+ * @return Length of the ETag.
+ */
+int file_etag(const char *path, const struct stat *st, ContentEncoding encoding, char *etag, size_t size)
+{
+    int compressed = encoding != ENCODING_IDENTITY && !is_sidecar(path, encoding);
+    return snprintf(etag, size, "\"%lx-%lx-%lx%s%s\"", (unsigned long)st->st_ino, (unsigned long)st->st_size,
+                    (unsigned long)(st->st_mtim.tv_sec * 1000000000L + st->st_mtim.tv_nsec), compressed ? "-" : "",
+                    compressed ? encoding_names[encoding] : "");
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Opens a file, reads it into memory if it is small enough (otherwise
+ *        keeps it open) and prepares its metadata and response header. For a
+ *        gzip variant of a file without a sidecar, the file is read whole and
+ *        compressed; if that does not pay off, or the result could never fit in a
+ *        shard, the entry only remembers so.
+ *
+ * @param path The file path.
+ * @param encoding The encoding it is sent with.
+ * @param hash Its cache hash.
+ * @param now_ms Current coarse time, the entry's first validation.
+ * @return A new entry holding one reference, or NULL if the file cannot be cached.
+ */
+CachedFile *load_file(const char *path, ContentEncoding encoding, uint32_t hash, uint64_t now_ms)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // small files are copied into memory, the rest are kept open if fds may be cached;
+    // compressed variants are always built in memory, and only if they can be kept
+    int compress = encoding != ENCODING_IDENTITY && !is_sidecar(path, encoding);
+    int in_memory = compress || (st.st_size <= FILE_CACHE_MAX_FILE && (size_t)st.st_size <= shard_budget);
+    if ((!in_memory && shard_fd_limit == 0) ||
+        (compress && (encoding != ENCODING_GZIP || shard_budget == 0 || st.st_size > COMPRESS_MAX_FILE)))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    CachedFile *entry = (CachedFile *)calloc(1, sizeof(CachedFile));
+    if (entry == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    entry->refs = 1;
+    entry->hash = hash;
+    entry->encoding = encoding;
+    entry->fd = fd;
+    entry->size = (size_t)st.st_size;
+    entry->disk_size = (size_t)st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->ino = st.st_ino;
+    entry->mime = get_mime_type(path);
+    entry->checked_ms = now_ms;
+    entry->path = strdup(path);
+    file_etag(path, &st, encoding, entry->etag, sizeof(entry->etag));
+
+    int loaded = entry->path != NULL;
+    if (loaded && in_memory)
+    {
+        size_t done = 0;
+        entry->body = (char *)malloc(entry->size ? entry->size : 1);
+        while (entry->body != NULL && done < entry->size)
+        {
+            ssize_t n = read(fd, entry->body + done, entry->size - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break; // error, or the file shrank while we read it
+            done += (size_t)n;
+        }
+        loaded = entry->body != NULL && done == entry->size;
+        close(fd);
+        entry->fd = -1;
+    }
+
+    if (loaded && compress)
+    {
+        char *compressed;
+        size_t compressed_len = 0;
+        entry->incompressible = gzip_buffer(entry->body, entry->size, &compressed, &compressed_len) < 0;
+        free(entry->body);
+        entry->body = compressed;
+        entry->size = compressed_len;
+        if (!entry->incompressible && compressed_len > shard_budget)
+        {
+            // inserting it would only empty the shard and fail, and the next request deflate it again
+            free(entry->body);
+            entry->body = NULL;
+            entry->size = 0;
+            entry->incompressible = 1;
+        }
+        if (entry->incompressible)
+            return entry; // nothing to send; the entry just stands for "serve the file itself"
+    }
+
+    int header_len = loaded ? file_header(path, &st, entry->size, encoding, &entry->header) : -1;
+    if (header_len < 0)
+    {
+        file_cache_release(entry);
+        return NULL;
+    }
+
+    entry->header_len = (size_t)header_len;
+    return entry;
+}
+
+/**
+ * @brief Checks that the file on disk is still the one that was read.
+ *
+ * @param entry The cached file.
+ * @return 1 if it is unchanged, 0 if it was modified, replaced or removed.
+ */
+int still_fresh(CachedFile *entry)
+{
+    struct stat st;
+    return stat(entry->path, &st) == 0 && st.st_ino == entry->ino &&
+           (size_t)st.st_size == entry->disk_size && st.st_mtim.tv_sec == entry->mtime.tv_sec &&
+           st.st_mtim.tv_nsec == entry->mtime.tv_nsec;
+}
+
+/**
+ * @brief Finds a path in a shard (lock held).
+ *
+ * @param shard The shard.
+ * @param path The file path.
+ * @param encoding The encoding it is sent with.
+ * @param hash Its cache hash.
+ * @return The entry, or NULL.
+ */
+CachedFile *find_entry(CacheShard *shard, const char *path, ContentEncoding encoding, uint32_t hash)
+{
+    CachedFile *entry = shard->buckets[(hash / FILE_CACHE_SHARDS) & (FILE_CACHE_SLOTS - 1)];
+    while (entry != NULL && (entry->hash != hash || entry->encoding != encoding || strcmp(entry->path, path) != 0))
+    {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+/**
+ * @brief Tells whether another thread is loading a file right now (lock held).
+ *
+ * @param shard The shard.
+ * @param path The file path.
+ * @param encoding The encoding it is sent with.
+ * @param hash Its cache hash.
+ * @return 1 if a load is in flight, 0 otherwise.
+ */
+int is_pending(CacheShard *shard, const char *path, ContentEncoding encoding, uint32_t hash)
+{
+    for (PendingLoad *pending = shard->pending; pending != NULL; pending = pending->next)
+    {
+        if (pending->hash == hash && pending->encoding == encoding && strcmp(pending->path, path) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Tells a precompressed sidecar ("site.css.gz" sent as gzip) from a
+ *        file to be compressed here ("site.css" sent as gzip).
+ *
+ * @param path The file path.
+ * @param encoding The encoding it is sent with.
+ * @return 1 if path already holds the encoded bytes, 0 otherwise.
+ */
+int is_sidecar(const char *path, ContentEncoding encoding)
+{
+    size_t path_len = strlen(path);
+    size_t suffix_len = strlen(encoding_suffixes[encoding]);
+    return encoding != ENCODING_IDENTITY && path_len > suffix_len &&
+           strcmp(path + path_len - suffix_len, encoding_suffixes[encoding]) == 0;
+}
+
+/**
+ * @brief Adds an entry to a shard (lock held), evicting others until it fits.
+ *        An entry that could not fit even in an empty shard evicts nothing.
+ *
+ * @param shard The shard.
+ * @param entry The new entry.
+ * @return 0 if it was added, -1 if the shard cannot make room.
+ */
+int insert_entry(CacheShard *shard, CachedFile *entry)
+{
+    size_t bytes = entry->body != NULL ? entry->size : 0;
+    if (bytes > shard_budget || (entry->fd >= 0 && shard_fd_limit == 0))
+        return -1;
+
+    while (shard->used + bytes > shard_budget || shard->count == FILE_CACHE_SLOTS)
+    {
+        if (!evict_one(shard, 0))
+            return -1;
+    }
+    while (entry->fd >= 0 && shard->fds >= shard_fd_limit)
+    {
+        if (!evict_one(shard, 1))
+            return -1;
+    }
+
+    int slot = shard->hand;
+    while (shard->clock[slot] != NULL)
+    {
+        slot = (slot + 1) & (FILE_CACHE_SLOTS - 1);
+    }
+    shard->clock[slot] = entry;
+    entry->slot = slot;
+
+    CachedFile **bucket = &shard->buckets[(entry->hash / FILE_CACHE_SHARDS) & (FILE_CACHE_SLOTS - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+
+    shard->used += bytes;
+    shard->fds += entry->fd >= 0;
+    shard->count++;
+    return 0;
+}
+
+/**
+ * @brief Takes an entry out of a shard (lock held) and drops the cache's reference.
+ *
+ * @param shard The shard.
+ * @param entry The entry.
+ */
+void remove_entry(CacheShard *shard, CachedFile *entry)
+{
+    CachedFile **link = &shard->buckets[(entry->hash / FILE_CACHE_SHARDS) & (FILE_CACHE_SLOTS - 1)];
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    shard->clock[entry->slot] = NULL;
+    shard->used -= entry->body != NULL ? entry->size : 0;
+    shard->fds -= entry->fd >= 0;
+    shard->count--;
+    file_cache_release(entry);
+}
+
+/**
+ * @brief Advances the clock hand to the first entry not hit since the hand
+ *        last passed it, clearing the bits on the way, and evicts it.
+ *
+ * @param shard The shard (lock held).
+ * @param need_fd Only consider entries holding an open fd.
+ * @return 1 if an entry was evicted, 0 if there is none to evict.
+ */
+int evict_one(CacheShard *shard, int need_fd)
+{
+    if (shard->count == 0 || (need_fd && shard->fds == 0))
+        return 0;
+
+    // two turns at most: the first may only clear referenced bits
+    for (int step = 0; step < 2 * FILE_CACHE_SLOTS; step++)
+    {
+        CachedFile *entry = shard->clock[shard->hand];
+        shard->hand = (shard->hand + 1) & (FILE_CACHE_SLOTS - 1);
+        if (entry == NULL || (need_fd && entry->fd < 0))
+            continue;
+        if (entry->referenced)
+        {
+            entry->referenced = 0;
+            continue;
+        }
+        remove_entry(shard, entry);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief FNV-1a hash of a path.
+ *
+ * @param path The path.
+ * @return The hash.
+ */
+uint32_t cache_hash(const char *path)
+{
+    uint32_t hash = 2166136261u;
+    for (; *path != '\0'; path++)
+    {
+        hash ^= (unsigned char)*path;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Cheap millisecond clock (a few ms of resolution is plenty for revalidation).
+ *
+ * @return Milliseconds on CLOCK_MONOTONIC_COARSE.
+ */
+uint64_t coarse_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,63 @@
+/**
+ * Summary: Header file for the static file cache: small files kept in memory and large files kept
+ *          open, each with its metadata and response header already prepared, so a hit is answered
+ *          without a path walk, stat() or open().
+ *
+ * @file file_cache.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include "docroot.h" // ContentEncoding
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define FILE_CACHE_SHARDS 16          // independently locked parts, picked by path hash
+#define FILE_CACHE_SLOTS 256          // most files one shard holds (power of two)
+#define FILE_CACHE_MAX_FILE (1 << 20) // larger files are kept as an open fd instead of in memory
+#define FILE_CACHE_REVALIDATE_MS 1000 // how long a hit is served before stat() checks the file again
+#define FILE_CACHE_ETAG_LEN 48
+#define DEFAULT_FILE_CACHE_MB 64      // memory for cached file contents (-C, 0 = keep none in memory)
+#define DEFAULT_FD_CACHE_SIZE 256     // open files kept for large files (-D, 0 = open them per request)
+
+// one cached file; shared by the cache and every response still sending it
+typedef struct CachedFile
+{
+    char *path; // resolved file path, the key together with encoding
+    ContentEncoding encoding; // a sidecar sent with Content-Encoding, or the file as it is
+    uint32_t hash;
+    char *header; // status line and entity headers; connection headers and blank line follow per response
+    size_t header_len;
+
+    // the body: in memory for small files, otherwise an fd sent from with explicit offsets
+    char *body;
+    int fd;
+    size_t size;
+
+    // metadata, compared on revalidation
+    size_t disk_size; // the file's size, which differs from size for a variant compressed here
+    struct timespec mtime;
+    ino_t ino;
+    const char *mime;
+    char etag[FILE_CACHE_ETAG_LEN];
+    uint64_t checked_ms;
+    int incompressible; // a gzip variant that saved too little or outgrew a shard: no body, lookups miss until the file changes
+
+    int refs;       // the cache's reference plus one per queued response
+    int referenced; // CLOCK bit: hit since the hand last passed
+    int slot;       // position in the shard's clock
+    struct CachedFile *next; // hash chain
+} CachedFile;
+
+int file_cache_init(size_t budget, int max_fds);
+CachedFile *file_cache_get(const char *path, ContentEncoding encoding);
+void file_cache_release(void *file);
+int file_header(const char *path, const struct stat *st, size_t size, ContentEncoding encoding, char **header);
+int file_etag(const char *path, const struct stat *st, ContentEncoding encoding, char *etag, size_t size);
+
+#endif
@@ -4,322 +4,544 @@
  * @file http_parser.c
  * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
  */
+#define _GNU_SOURCE
+
 #include "http_parser.h"
+#include "compress.h"
+#include "docroot.h"
+#include "file_cache.h"
+#include "known_headers.h" // generated from known_headers.txt at build time
+#include "logger.h"
+#include "pack.h"
 #include "thread_pool.h"
-#include "../lib/uthash.h"
+#include "token_scan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#define VARY_HEADER "Vary: Accept-Encoding\r\n" // on every response of a file that has sidecars
+#define MAX_RANGES 16 // ranges honored in one Range header; a request for more gets the whole file
+
 // Mutex for stats page
 int total_requests = 0;
 pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
 // --- HTTP structures ---
+// a view into the connection's receive buffer; not null terminated
+typedef struct Slice
+{
+    const char *ptr;
+    size_t len;
+} Slice;
+
 typedef struct HTTPHeader
 {
-    char key[64]; // header name such as "Host" or "Content Type"
-    char value[256];
-    UT_hash_handle hh; // makes the header hashable
-} HTTPHeader;          // full header example "Host: www.example.com";
+    Slice key; // header name such as "Host" or "Content-Type"
+    Slice value;
+} HTTPHeader; // full header example "Host: www.example.com";
 
+// everything points into the receive buffer, so building a request allocates nothing
 typedef struct HTTPRequest
 {
-    char method[10];
-    char path[1024];
-    char version[10];
-    HTTPHeader *headers; // pointer to head of the HTTPHeader hash table
+    Slice method;
+    Slice path;
+    Slice version;
+    HTTPHeader headers[MAX_HEADERS];
+    int num_headers;
+    uint8_t known[NUM_KNOWN_HEADERS]; // 1 + index into headers, 0 if absent; others stay in headers
 } HTTPRequest;
 
+// one requested byte range of a body, both ends included as in Content-Range
+typedef struct ByteRange
+{
+    uint64_t first;
+    uint64_t last;
+} ByteRange;
+
+// where a file's body is sent from, so any range of it can be queued alike
+typedef struct BodySource
+{
+    const char *data;             // the body in memory, or NULL to send it from fd
+    int fd;
+    off_t offset;                 // where the body starts in fd
+    uint64_t size;
+    void (*release)(void *owner); // gives the body back after the last range; NULL if fd is ours to close
+    void *owner;
+} BodySource;
+
 // --- FUNCTION DECLERATIONS ---
-void create_root_path(char *filepath, HTTPRequest *rq);
-void delete_all_headers(HTTPHeader **headers);
-void add_header_to_hash(HTTPHeader **headers, const char *key, const char *value);
-void clean_request(char *buffer);
-int parse_request(const char *buffer, HTTPRequest *rq);
-int is_valid_method(char *method);
-int is_valid_version(char *version);
-int parse_request_line(const char *line, HTTPRequest *rq);
-void parse_single_header(char *line, HTTPRequest *rq);
-void handle_request(int clientfd, const char *buffer);
-void send_error_response(const char *filepath, int clientfd, int status_code);
-void serve_file(int clientfd, const char *filepath, off_t filesize);
+KnownHeader classify_header(Slice key);
+const Slice *request_header(HTTPRequest *rq, KnownHeader id);
+int slice_equals(Slice slice, const char *text);
+int parser_feed(RequestParser *parser, const char *buffer, size_t len);
+void skip_token(RequestParser *parser, const char *buffer, size_t len);
+void parser_reset(RequestParser *parser);
+int request_ready(Connection *conn);
+int parse_request(const char *buffer, RequestParser *parser, HTTPRequest *rq);
+int is_valid_method(Slice method);
+int is_valid_version(Slice version);
+Slice span_slice(const char *buffer, Span span);
+void handle_request(Connection *conn);
+void process_request(Connection *conn);
+int wants_keep_alive(Connection *conn, HTTPRequest *rq);
+int list_has_token(Slice value, const char *token);
+void connection_headers(Connection *conn, char *headers, size_t size);
+void send_error_response(const char *filepath, Connection *conn, int status_code);
+void serve_file(Connection *conn, struct HTTPRequest *rq, const char *filepath, const struct stat *st,
+                const DocVariant *variant);
+void http_date(time_t when, char *out, size_t size);
+void serve_cached(Connection *conn, HTTPRequest *rq, CachedFile *file, int vary);
+void serve_packed(Connection *conn, HTTPRequest *rq, const PackEntry *entry, const char *filepath);
+int serve_ranges(Connection *conn, HTTPRequest *rq, const char *filepath, const char *header, size_t header_len,
+                 const BodySource *body, const char *etag, size_t etag_len, time_t mtime, int vary);
+int queue_range(Connection *conn, const BodySource *body, uint64_t start, uint64_t len, int last);
+void drop_body(const BodySource *body);
+void hold_body(void *owner);
+void fail_response(Connection *conn);
+int parse_ranges(Slice header, uint64_t size, ByteRange *ranges, int max);
+int if_range_matches(HTTPRequest *rq, const char *etag, size_t etag_len, time_t mtime);
+unsigned accepted_encodings(const Slice *header);
+int not_modified(HTTPRequest *rq, const char *etag, size_t etag_len, time_t mtime);
+void send_not_modified(Connection *conn, const char *filepath, const char *etag, size_t etag_len, time_t mtime,
+                       int vary);
+int etag_matches(Slice header, const char *etag, size_t etag_len);
+int parse_http_date(Slice value, time_t *when);
 const char *get_mime_type(const char *filepath);
 
 // --- FUNCTIONS ---
 /**
- * @brief Creates the full file path for the requested resource.
+ * @brief Receives everything the client has sent so far into the connection buffer.
+ *        The socket is non-blocking and edge-triggered, so we read until recv() would block.
  *
- * @param filepath Pointer to the buffer where the full file path will be stored.
- * @param rq Pointer to the HTTPRequest structure containing the request details.
+ * @param conn The connection to read from.
+ * @return The number of bytes received (possibly 0), -1 on failure.
  */
-void create_root_path(char *filepath, HTTPRequest *rq)
+ssize_t receive_message(Connection *conn)
 {
-    // security check to block access to www parent folders
-    if (strstr(rq->path, "..") != NULL)
-    {
-        sprintf(filepath, "invalid_path");
-        return;
-    }
+    ssize_t total = 0; // amnt of bytes read from client
 
-    // create root directory path so source files are seperate from server files
-    if (strcmp(rq->path, "/") == 0)
+    while (conn->in_len < CONN_BUFFER_SIZE - 1)
     {
-        sprintf(filepath, "www/index.html");
+        ssize_t bytes_read = recv(conn->fd, conn->in_buf + conn->in_len,
+                                  CONN_BUFFER_SIZE - 1 - conn->in_len, 0);
+        if (bytes_read < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            perror("recv failed");
+            return -1;
+        }
+        else if (bytes_read == 0)
+        {
+            conn->peer_closed = 1; // client disconnected
+            break;
+        }
 
-        printf(" - handling request for path: %s\n", rq->path);
-    } // construct full file path
-    else
-    {
-        sprintf(filepath, "server-side/www%s", rq->path);
+        conn->in_len += bytes_read;
+        total += bytes_read;
     }
+
+    // null terminate what's in buffer so we can treat it as a c-string
+    conn->in_buf[conn->in_len] = '\0';
+    return total;
 }
 
 /**
- * @brief Receives a message from the client socket.
+ * @brief Advances the request parser over the bytes received since its last call.
+ *        The parser walks the buffer one byte at a time and only remembers offsets,
+ *        so a request split across any number of reads is parsed without copying
+ *        and without rescanning what it has already seen. Inside the path, header
+ *        names and header values, runs of ordinary bytes are skipped with the
+ *        vectorized scan_token(). Bare "\n" line endings are accepted so
+ *        requests can still be typed with netcat.
  *
- * @param clientfd The client socket file descriptor.
- * @param buffer Pointer to the buffer where the received message will be stored.
- * @return The number of bytes received on success, -1 on failure.
+ * @param parser The connection's parser state.
+ * @param buffer The receive buffer, starting at the first byte of the request.
+ * @param len Number of bytes received so far.
+ * @return 1 when the header block is complete, 0 if more bytes are needed, -1 if malformed.
  */
-ssize_t receive_message(int clientfd, char *buffer)
+int parser_feed(RequestParser *parser, const char *buffer, size_t len)
 {
-    ssize_t bytes_read; // amnt of bytes read from client
-
-    bytes_read = recv(clientfd, buffer, BUFFER_SIZE - 1, 0);
-    if (bytes_read < 0)
+    while (parser->pos < len && parser->state != PARSE_DONE && parser->state != PARSE_ERROR)
     {
-        perror("recv failed");
-        return -1;
-    }
-    else if (bytes_read == 0)
-    {
-        printf(" - client disconnected");
-        return 0;
-    }
-    else
-    {
-        // null terminate what's in buffer so we can treat it as a c-string
-        buffer[bytes_read] = '\0';
-        handle_request(clientfd, buffer);
+        // jump straight to the next byte the state machine has to look at
+        if (parser->state == PARSE_PATH || parser->state == PARSE_HEADER_KEY ||
+            parser->state == PARSE_VALUE)
+        {
+            skip_token(parser, buffer, len);
+            if (parser->pos == len)
+                break;
+        }
+
+        size_t pos = parser->pos++;
+        unsigned char ch = (unsigned char)buffer[pos];
+
+        switch (parser->state)
+        {
+        case PARSE_START:
+            if (ch >= 'A' && ch <= 'Z')
+            {
+                parser->mark = pos;
+                parser->state = PARSE_METHOD;
+            }
+            else if (ch != '\r' && ch != '\n')
+            {
+                parser->state = PARSE_ERROR;
+            }
+            break;
+
+        case PARSE_METHOD:
+            if (ch == ' ')
+            {
+                parser->method.off = parser->mark;
+                parser->method.len = pos - parser->mark;
+                parser->state = PARSE_BEFORE_PATH;
+            }
+            else if (ch < 'A' || ch > 'Z')
+            {
+                parser->state = PARSE_ERROR;
+            }
+            break;
+
+        case PARSE_BEFORE_PATH:
+        case PARSE_BEFORE_VERSION:
+            if (ch == ' ')
+                break;
+            if (ch <= ' ' || ch == 0x7f)
+            {
+                parser->state = PARSE_ERROR; // the request line needs all three parts
+                break;
+            }
+            parser->mark = pos;
+            parser->state = parser->state == PARSE_BEFORE_PATH ? PARSE_PATH : PARSE_VERSION;
+            break;
+
+        case PARSE_PATH:
+            if (ch == ' ')
+            {
+                parser->path.off = parser->mark;
+                parser->path.len = pos - parser->mark;
+                parser->state = PARSE_BEFORE_VERSION;
+            }
+            else if (ch < ' ' || ch == 0x7f)
+            {
+                parser->state = PARSE_ERROR;
+            }
+            break;
+
+        case PARSE_VERSION:
+            if (ch == '\r' || ch == '\n')
+            {
+                parser->version.off = parser->mark;
+                parser->version.len = pos - parser->mark;
+                parser->state = ch == '\r' ? PARSE_LINE_END : PARSE_HEADER_START;
+            }
+            else if (ch <= ' ' || ch == 0x7f)
+            {
+                parser->state = PARSE_ERROR;
+            }
+            break;
+
+        case PARSE_LINE_END:
+            parser->state = ch == '\n' ? PARSE_HEADER_START : PARSE_ERROR;
+            break;
+
+        case PARSE_HEADER_START:
+            if (ch == '\r')
+            {
+                parser->state = PARSE_HEADERS_END;
+            }
+            else if (ch == '\n')
+            {
+                parser->state = PARSE_DONE;
+            }
+            else if (ch < 0x20 || ch == 0x7f)
+            {
+                parser->state = PARSE_ERROR; // includes obsolete line folding
+            }
+            else
+            {
+                parser->mark = pos;
+                parser->state = PARSE_HEADER_KEY;
+            }
+            break;
+
+        case PARSE_HEADER_KEY:
+            if (ch == ':')
+            {
+                if (parser->num_headers == MAX_HEADERS)
+                {
+                    parser->state = PARSE_ERROR;
+                    break;
+                }
+                HeaderSpan *header = &parser->headers[parser->num_headers];
+                header->key.off = parser->mark;
+                header->key.len = pos - parser->mark;
+                parser->state = PARSE_BEFORE_VALUE;
+            }
+            else if (ch == '\r')
+            {
+                parser->state = PARSE_IGNORED_LINE;
+            }
+            else if (ch == '\n')
+            {
+                parser->state = PARSE_HEADER_START;
+            }
+            else if (ch < 0x20 || ch == 0x7f)
+            {
+                parser->state = PARSE_ERROR;
+            }
+            break;
+
+        case PARSE_BEFORE_VALUE:
+            if (ch == ' ' || ch == '\t')
+                break;
+            parser->mark = pos;
+            parser->value_end = pos;
+            parser->state = PARSE_VALUE;
+            // fall through: the first value byte may already end the line
+        case PARSE_VALUE:
+            if (ch == '\r' || ch == '\n')
+            {
+                HeaderSpan *header = &parser->headers[parser->num_headers++];
+                header->value.off = parser->mark;
+                header->value.len = parser->value_end - parser->mark;
+                parser->state = ch == '\r' ? PARSE_LINE_END : PARSE_HEADER_START;
+            }
+            else if ((ch < 0x20 && ch != '\t') || ch == 0x7f)
+            {
+                parser->state = PARSE_ERROR;
+            }
+            else if (ch != ' ' && ch != '\t')
+            {
+                parser->value_end = pos + 1; // trailing blanks are not part of the value
+            }
+            break;
+
+        case PARSE_IGNORED_LINE:
+            parser->state = ch == '\n' ? PARSE_HEADER_START : PARSE_ERROR;
+            break;
+
+        case PARSE_HEADERS_END:
+            parser->state = ch == '\n' ? PARSE_DONE : PARSE_ERROR;
+            break;
+
+        default:
+            break;
+        }
     }
-    return bytes_read;
+
+    if (parser->state == PARSE_DONE)
+        return 1;
+    if (parser->state == PARSE_ERROR)
+        return -1;
+    return 0;
 }
 
 /**
- * @brief Adds a header key-value pair to the HTTPHeader hash table.
+ * @brief Skips the run of ordinary token bytes at the parser's position: everything
+ *        up to the next control byte, or the space ending the path, or the colon
+ *        ending a header name. Keeps value_end on the last non-blank value byte.
  *
- * @param headers Pointer to the pointer of the head of the HTTPHeader hash table.
- * @param key The header name (e.g., "Host").
- * @param value The header value (e.g., "www.example.com").
+ * @param parser The connection's parser state, in a path, name or value state.
+ * @param buffer The receive buffer.
+ * @param len Number of bytes received so far.
  */
-void add_header_to_hash(HTTPHeader **headers, const char *key, const char *value)
+void skip_token(RequestParser *parser, const char *buffer, size_t len)
 {
-    HTTPHeader *s = (HTTPHeader *)malloc(sizeof(HTTPHeader));
-    if (s == NULL)
-    {
-        perror("failed to allcoate HTTPHeader on the heap");
-        return;
-    }
+    char stop = '\0'; // values only end at control bytes (CR, LF)
+    if (parser->state == PARSE_PATH)
+        stop = ' ';
+    else if (parser->state == PARSE_HEADER_KEY)
+        stop = ':';
 
-    const char *trimmed_val = value;
-    while (*trimmed_val == ' ')
+    size_t start = parser->pos;
+    size_t end = start + scan_token(buffer + start, len - start, stop);
+
+    if (parser->state == PARSE_VALUE)
     {
-        trimmed_val++;
+        size_t last = end;
+        while (last > start && buffer[last - 1] == ' ')
+        {
+            last--;
+        }
+        if (last > start)
+            parser->value_end = last;
     }
-
-    strncpy(s->key, key, sizeof(s->key));
-    s->key[sizeof(s->key) - 1] = '\0';
-    strncpy(s->value, trimmed_val, sizeof(s->value));
-    s->value[sizeof(s->value) - 1] = '\0';
-
-    HASH_ADD_STR(*headers, key, s);
+    parser->pos = end;
 }
 
 /**
- * @brief Cleans the entire HTTP Request, replacing '\r' with ' ',
- *        so that we can send HTTP requests with netcat. Also just makes
- *        handling of requests more flexible.
- * @param buffer The buffer that holds the request
+ * @brief Prepares the parser for the next request on the connection.
+ *
+ * @param parser The connection's parser state.
  */
-void clean_request(char *buffer)
+void parser_reset(RequestParser *parser)
 {
-    int i;
+    parser->state = PARSE_START;
+    parser->pos = 0;
+    parser->num_headers = 0;
+}
 
-    for (i = 0; buffer[i] == '\0'; i++)
-    {
-        if (buffer[i] == '\r')
-        {
-            buffer[i] = ' ';
-        }
-    }
+/**
+ * @brief Feeds newly received bytes to the connection's parser and tells whether a
+ *        worker has something to answer: a complete request or a malformed one (400).
+ *
+ * @param conn The connection whose receive buffer to check.
+ * @return 1 if the first buffered request is complete or malformed, 0 if more bytes are needed.
+ */
+int request_ready(Connection *conn)
+{
+    return parser_feed(&conn->parser, conn->in_buf, conn->in_len) != 0;
 }
 
 /**
- * @brief Formats and prints the provided HTTP request, including
- *        its headers
+ * @brief Logs the provided HTTP request, including its headers, at debug level.
+ *        Callers check log_enabled(LOG_DEBUG) first, so this costs nothing otherwise.
  * @param rq The HTTPRequest struct to print
  */
 void print_http_request(HTTPRequest *rq){
-    printf("\n--- Parsed HTTP Request ---\n");
-    printf("Method: %s\n", rq->method);
-    printf("Path: %s\n", rq->path);
-    printf("Version: %s\n", rq->version);
+    LOG(LOG_DEBUG, "--- Parsed HTTP Request ---");
+    LOG(LOG_DEBUG, "Method: %.*s", (int)rq->method.len, rq->method.ptr);
+    LOG(LOG_DEBUG, "Path: %.*s", (int)rq->path.len, rq->path.ptr);
+    LOG(LOG_DEBUG, "Version: %.*s", (int)rq->version.len, rq->version.ptr);
 
-    printf("Headers:\n");
-    HTTPHeader *current_header, *tmp;
-    HASH_ITER(hh, rq->headers, current_header, tmp)
+    LOG(LOG_DEBUG, "Headers:");
+    for (int i = 0; i < rq->num_headers; i++)
     {
-        printf(" - %s: %s\n", current_header->key, current_header->value);
+        HTTPHeader *header = &rq->headers[i];
+        LOG(LOG_DEBUG, " - %.*s: %.*s", (int)header->key.len, header->key.ptr,
+            (int)header->value.len, header->value.ptr);
     }
-    printf("---------------------------\n");
+    LOG(LOG_DEBUG, "---------------------------");
 }
 
 /**
- * @brief Parse the http request in buffer and populate HTTPRequest and
- *        HTTPHeader structures.
+ * @brief Populates the HTTPRequest with views of the spans the request parser
+ *        recorded over buffer. Nothing is copied or allocated.
  *
  * @param buffer Pointer to the buffer containing the HTTP request.
+ * @param parser The parser that walked the request.
  * @param rq Pointer to the HTTPRequest structure to be populated.
+ * @return 200 on success, 400 if the request is malformed or unsupported.
  */
-int parse_request(const char *buffer, HTTPRequest *rq)
+int parse_request(const char *buffer, RequestParser *parser, HTTPRequest *rq)
 {
-    char *buffer_copy = strdup(buffer); // make a modifiable copy of buffer;
-    if (buffer_copy == NULL)
-    {
-        printf(" - ❌ Error: strdup() failed");
-        return 500; // internal server error
-    }
-
-    char *line_token, *saveptr_line;
-    clean_request(buffer_copy);
-    line_token = strtok_r(buffer_copy, "\n", &saveptr_line); // get first line
-
-    if (line_token == NULL) // check for empty request
+    if (parser->state != PARSE_DONE)
     {
-        fprintf(stderr, "malformed request: empty or missing request line.\n");
-        free(buffer_copy);
+        LOG(LOG_WARN, "malformed request: could not parse request line or headers.");
         return 400; // bad request
     }
 
-    if (parse_request_line(line_token, rq) != 0) // parse request line, return 400 if parsing failed
-    {
-        free(buffer_copy);
-        return 400; // bad request
-    }
+    rq->method = span_slice(buffer, parser->method);
+    rq->path = span_slice(buffer, parser->path);
+    rq->version = span_slice(buffer, parser->version);
 
-    while ((line_token = strtok_r(NULL, "\n", &saveptr_line)) != NULL) // Parse headers
+    if (!is_valid_method(rq->method) || !is_valid_version(rq->version))
     {
-        parse_single_header(line_token, rq);
+        return 400;
     }
 
-    print_http_request(rq);
-
-    free(buffer_copy); // free writable copy of the http request buffer
-    return 200;        // status = ok
-}
-
-/**
- * @brief Parses the request line of the HTTP request.
- *
- * @param line The request line to be parsed.
- * @param rq Pointer to the HTTPRequest structure to be populated.
- *
- * @return 0 on success, -1 on failure.
- */
-int parse_request_line(const char *line, HTTPRequest *rq)
-{
-
-    if (sscanf(line, "%9s%1023s%9s", rq->method, rq->path, rq->version) != 3)
+    memset(rq->known, 0, sizeof(rq->known));
+    rq->num_headers = parser->num_headers;
+    for (int i = 0; i < parser->num_headers; i++)
     {
-        fprintf(stderr, "malformed request line: %s\n", line);
-        return -1;
-    }
+        HTTPHeader *header = &rq->headers[i];
+        header->key = span_slice(buffer, parser->headers[i].key);
+        header->value = span_slice(buffer, parser->headers[i].value);
 
-    if (!is_valid_method(rq->method) || !is_valid_version(rq->version))
-    {
-        return -1;
+        // the first occurrence of a known header wins
+        KnownHeader id = classify_header(header->key);
+        if (id != HEADER_OTHER && rq->known[id] == 0)
+        {
+            rq->known[id] = i + 1;
+        }
     }
 
-    return 0;
+    if (log_enabled(LOG_DEBUG))
+        print_http_request(rq);
+    return 200; // status = ok
 }
 
 /**
- * @brief Parses a single HTTP header line and adds it to the HTTPRequest structure.
+ * @brief Handles the first request buffered on the connection, then drops its bytes
+ *        so whatever follows is kept for the next request on a persistent connection.
  *
- * @param line The header line to be parsed.
- * @param rq Pointer to the HTTPRequest structure to which the header will be added.
+ * @param conn The connection holding the received HTTP request.
  */
-void parse_single_header(char *line, HTTPRequest *rq)
+void handle_request(Connection *conn)
 {
-    char *key = line;
+    // a malformed request closes the connection, so all of the buffer can go
+    size_t request_len = conn->parser.state == PARSE_DONE ? conn->parser.pos : conn->in_len;
 
-    // strchr() searches for first occurence of ":" in line_token and returns pointer to
-    // location in array
-    char *value = strchr(line, ':');
+    process_request(conn);
 
-    if (value)
-    {
-        *value = '\0'; // null terminate the key
-        value++;       // move past the colon to the start of the value
-
-        add_header_to_hash(&rq->headers, key, value);
-    }
+    // anything after this request belongs to the next one (include the null terminator)
+    memmove(conn->in_buf, conn->in_buf + request_len, conn->in_len - request_len + 1);
+    conn->in_len -= request_len;
+    conn->requests_served++;
+    parser_reset(&conn->parser);
 }
 
 /**
- * @brief Parses and handles the requests received from the client.
- *        Only handles HTTP requests.
+ * @brief Parses and handles one request. Only handles HTTP requests. The response
+ *        is queued on the connection for the event loop to send.
  *
- * @param clientfd The client socket file descriptor.
- * @param buffer Pointer to the buffer containing the received HTTP request.
+ * @param conn The connection holding the received (and already parsed) HTTP request.
  */
-void handle_request(int clientfd, const char *buffer)
+void process_request(Connection *conn)
 {
     pthread_mutex_lock(&stats_mutex);   
     total_requests++; 
     pthread_mutex_unlock(&stats_mutex); 
     HTTPRequest rq;
-    /*
-    MUST be initialized to NULL to indicate an empty hash table.
-    When adding headers, uthash macros handle hash table management.
-    */
-    rq.headers = NULL; // ptr to head of HTTPHeader hash table
-    int status = parse_request(buffer, &rq); // parse client request
+    int status = parse_request(conn->in_buf, &conn->parser, &rq); // parse client request
     
     if (status != 200)// error check
     {
-        send_error_response("Request Parsing", clientfd, status);
+        conn->keep_alive = 0; // can't trust where the next request starts
+        send_error_response("Request Parsing", conn, status);
         return;
     }
-    if (strcmp(rq.path, "/api/stats") == 0)
-    {
-        char response[1024];
-        char body[256];
+    conn->keep_alive = wants_keep_alive(conn, &rq);
 
+    char conn_headers[128];
+    connection_headers(conn, conn_headers, sizeof(conn_headers));
+
+    if (slice_equals(rq.path, "/api/stats"))
+    {
         pthread_mutex_lock(&stats_mutex);
         int current_total = total_requests;
-        int current_queue = queue_count;
         pthread_mutex_unlock(&stats_mutex);
+        int current_workers = thread_pool_workers();
+        int current_busy = thread_pool_busy();
+        int current_queue = thread_pool_queued();
 
-        // Create JSON (JavaScript Object Notation)
-        sprintf(body, "{\"active\": %d, \"queue\": %d, \"total\": %d}", 
-                NUM_THREADS, current_queue, current_total);
-
-        sprintf(response, "HTTP/1.1 200 OK\r\n"
-                          "Content-Type: application/json\r\n"
-                          "Content-Length: %ld\r\n"
-                          "Connection: close\r\n"
-                          "\r\n"
-                          "%s", strlen(body), body);
+        // Create JSON (JavaScript Object Notation); measured first, then formatted straight after the headers
+        static const char json_format[] = "{\"active\": %d, \"workers\": %d, \"queue\": %d, \"total\": %d}";
+        int body_len = snprintf(NULL, 0, json_format, current_busy, current_workers, current_queue, current_total);
 
-        send(clientfd, response, strlen(response), 0);
-        delete_all_headers(&rq.headers);
+        // status line, headers and body are formatted back to back so they leave in one write
+        if (conn_printf(conn, "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: application/json\r\n"
+                              "Content-Length: %d\r\n"
+                              "%s"
+                              "\r\n",
+                        body_len, conn_headers) < 0 ||
+            conn_printf(conn, json_format, current_busy, current_workers, current_queue, current_total) < 0)
+            fail_response(conn);
         return;
     }
-    if (strcmp(rq.path, "/stats") == 0)
+    if (slice_equals(rq.path, "/stats"))
     {
-        // WARNING: We need a bigger buffer for all this HTML/CSS!
-        char response[4096]; 
-        char body[3072]; 
-
-        sprintf(body, 
+        // the page never changes, so it is copied out as is
+        static const char stats_page[] =
             "<html><head>"
             "<title>Server Dashboard</title>"
             "<style>"
@@ -340,6 +562,10 @@ void handle_request(int clientfd, const char *buffer)
             "    <div class='stat-value' id='active'>-</div>"
             "  </div>"
             "  <div class='stat-box'>"
+            "    <div class='stat-label'>Pool Size</div>"
+            "    <div class='stat-value' id='workers'>-</div>"
+            "  </div>"
+            "  <div class='stat-box'>"
             "    <div class='stat-label'>Queue Size</div>"
             "    <div class='stat-value' id='queue'>-</div>"
             "  </div>"
@@ -356,6 +582,7 @@ void handle_request(int clientfd, const char *buffer)
             "      .then(response => response.json())"
             "      .then(data => {"
             "        document.getElementById('active').innerText = data.active;"
+            "        document.getElementById('workers').innerText = data.workers;"
             "        document.getElementById('queue').innerText = data.queue;"
             "        document.getElementById('total').innerText = data.total;"
             "      });"
@@ -363,141 +590,902 @@ void handle_request(int clientfd, const char *buffer)
             "  setInterval(updateStats, 500);" // Run every 0.5 seconds
             "  updateStats();" // Run immediately on load
             "</script>"
-            "</body></html>");
+            "</body></html>";
 
-        sprintf(response, "HTTP/1.1 200 OK\r\n"
-                          "Content-Type: text/html\r\n"
-                          "Content-Length: %ld\r\n"
-                          "Connection: close\r\n"
-                          "\r\n"
-                          "%s", strlen(body), body);
-
-        send(clientfd, response, strlen(response), 0);
-        delete_all_headers(&rq.headers);
+        if (conn_printf(conn, "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: text/html\r\n"
+                              "Content-Length: %zu\r\n"
+                              "%s"
+                              "\r\n",
+                        sizeof(stats_page) - 1, conn_headers) < 0 ||
+            conn_write(conn, stats_page, sizeof(stats_page) - 1) < 0)
+            fail_response(conn);
         return;
     }
     // double the PATH_LEN to accommodate full file paths without overflow risk
     char filepath[PATH_LEN * 2];
-    create_root_path(filepath, &rq);
-    
-    // error check for bad request
-    if (strcmp(filepath, "invalid_path") == 0)
+    const PackEntry *packed = NULL;
+    DocVariant variant = {ENCODING_IDENTITY, 0, 0};
+    unsigned accepted = accepted_encodings(request_header(&rq, HEADER_ACCEPT_ENCODING));
+    DocResult found = pack_active()
+                          ? pack_resolve(rq.path.ptr, rq.path.len, accepted, &packed, filepath, sizeof(filepath))
+                          : docroot_resolve(rq.path.ptr, rq.path.len, accepted, filepath, sizeof(filepath), &variant);
+    LOG(LOG_DEBUG, " - handling request for path: %.*s -> %s", (int)rq.path.len, rq.path.ptr, filepath);
+
+    // error check for bad request; anything not in the index is missing without asking the disk
+    if (found == DOC_INVALID)
+    {
+        send_error_response(filepath, conn, 400);
+        return;
+    }
+    if (found == DOC_MISSING)
+    {
+        send_error_response(filepath, conn, 404);
+        return;
+    }
+
+    // everything in a pack is already in memory (or sent from the pack's fd)
+    if (packed != NULL)
+    {
+        serve_packed(conn, &rq, packed, filepath);
+        return;
+    }
+
+    // text files without a sidecar are gzipped here once and the result cached
+    if (variant.encoding == ENCODING_IDENTITY && compress_eligible(filepath, variant.size))
+    {
+        variant.vary = 1;
+        CachedFile *compressed =
+            (accepted & (1u << ENCODING_GZIP)) ? file_cache_get(filepath, ENCODING_GZIP) : NULL;
+        if (compressed != NULL)
+        {
+            serve_cached(conn, &rq, compressed, 1);
+            return;
+        }
+    }
+
+    // cached files need no stat() or open(): small ones come from memory, large ones from a kept fd
+    CachedFile *cached = file_cache_get(filepath, variant.encoding);
+    if (cached != NULL)
     {
-        send_error_response(filepath, clientfd, 400);
+        serve_cached(conn, &rq, cached, variant.vary);
         return;
     }
 
     struct stat file_stat; // will contain info about the file
 
-    // "if file doesn't exist...""
+    // the index may lag the disk by a moment, so the file can still be gone
     if (stat(filepath, &file_stat) < 0)
     {
-        send_error_response(filepath, clientfd, 404); // writes states about what's at filepath to filestat
+        send_error_response(filepath, conn, 404); // writes states about what's at filepath to filestat
     } else {
-        serve_file(clientfd, filepath, file_stat.st_size);
+        serve_file(conn, &rq, filepath, &file_stat, &variant);
+    }
+}
+
+/**
+ * @brief Decides whether the connection stays open after this request.
+ *        HTTP/1.1 connections are persistent unless the client sends
+ *        "Connection: close" or the per-connection request cap is reached.
+ *
+ * @param conn The client connection.
+ * @param rq The parsed request.
+ * @return 1 to keep the connection open, 0 to close it after the response.
+ */
+int wants_keep_alive(Connection *conn, HTTPRequest *rq)
+{
+    if (conn->requests_served + 1 >= KEEPALIVE_MAX_REQUESTS)
+    {
+        return 0;
+    }
+
+    // Connection is a list of options and may be sent more than once; "close" anywhere in it counts
+    for (int i = rq->known[HEADER_CONNECTION] - 1; i >= 0 && i < rq->num_headers; i++)
+    {
+        if (classify_header(rq->headers[i].key) == HEADER_CONNECTION &&
+            list_has_token(rq->headers[i].value, "close"))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Checks a comma separated header value, e.g. "keep-alive, Close", for
+ *        one whole token (case-insensitive, blanks around elements ignored).
+ *
+ * @param value The header value.
+ * @param token The token to look for.
+ * @return 1 if one of the elements is token, 0 otherwise.
+ */
+int list_has_token(Slice value, const char *token)
+{
+    size_t token_len = strlen(token);
+    const char *p = value.ptr;
+    const char *end = value.ptr + value.len;
+    while (p < end)
+    {
+        const char *element_end = memchr(p, ',', (size_t)(end - p));
+        if (element_end == NULL)
+            element_end = end;
+
+        const char *last = element_end;
+        while (p < last && (*p == ' ' || *p == '\t'))
+            p++;
+        while (last > p && (last[-1] == ' ' || last[-1] == '\t'))
+            last--;
+        if ((size_t)(last - p) == token_len && strncasecmp(p, token, token_len) == 0)
+            return 1;
+        p = element_end + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Formats the Connection (and Keep-Alive) response headers for the connection.
+ *
+ * @param conn The client connection.
+ * @param headers Buffer receiving the header lines, each ending in "\r\n".
+ * @param size Size of the headers buffer.
+ */
+void connection_headers(Connection *conn, char *headers, size_t size)
+{
+    if (conn->keep_alive)
+    {
+        snprintf(headers, size, "Connection: keep-alive\r\n"
+                                "Keep-Alive: timeout=%d, max=%d\r\n",
+                 KEEPALIVE_TIMEOUT, KEEPALIVE_MAX_REQUESTS - conn->requests_served - 1);
+    }
+    else
+    {
+        snprintf(headers, size, "Connection: close\r\n");
     }
-    delete_all_headers(&rq.headers); // clean up allocated hash table memory
 }
 
 /**
  * @brief Sends an error response to the client based on the status code.
  *
  * @param filepath The file path related to the error.
- * @param clientfd The client socket file descriptor.
+ * @param conn The client connection.
  * @param status_code The HTTP status code indicating the type of error.
  */
-void send_error_response(const char *filepath, int clientfd, int status_code)
+void send_error_response(const char *filepath, Connection *conn, int status_code)
 {
-    char response[256];
-
-    // safely print error message to server console
-    log_request(clientfd, "GET", (char *)filepath, status_code);
+    char conn_headers[128];
+    const char *status_line;
+    uint64_t queued = conn->queued_bytes;
 
     // create response for client
     if (status_code == 400)
     {
-        sprintf(response, "HTTP/1.1 400 Bad Request ❌\r\n");
+        status_line = "HTTP/1.1 400 Bad Request ❌";
     }
     else if (status_code == 404)
     {
-        sprintf(response, "HTTP/1.1 404 Not Found ❌\r\n");
+        status_line = "HTTP/1.1 404 Not Found ❌";
     }
     else
     {
-        sprintf(response, "HTTP/1.1 500 Internal Server Error ❌❌\r\n");
+        status_line = "HTTP/1.1 500 Internal Server Error ❌❌";
     }
 
-    if (send(clientfd, response, strlen(response), 0) < 0)
+    // empty body, so a persistent connection knows where the next response starts
+    connection_headers(conn, conn_headers, sizeof(conn_headers));
+    if (conn_printf(conn, "%s\r\n"
+                          "Content-Length: 0\r\n"
+                          "%s"
+                          "\r\n",
+                    status_line, conn_headers) < 0)
     {
-        printf(" - ❌ Error sending error message.\n");
+        fail_response(conn);
+        return;
     }
+
+    // hand the error line to the logger; it is written out on the log thread
+    log_request(conn->fd, "GET", filepath, status_code, conn->queued_bytes - queued, conn->enqueued_ns);
 }
 
 /**
- * @brief Prepares and sends the requested resource to the client.
+ * @brief Prepares the requested resource for the client. The header is queued
+ *        on the connection and the open file is attached as the body, which the
+ *        event loop streams out as the socket accepts it. A revalidation is
+ *        answered from the stat() alone with a 304, without opening the file,
+ *        and a Range request gets only the ranges it asks for.
  *
- * @param clientfd The client socket file descriptor.
+ * @param conn The client connection.
+ * @param rq The parsed request, for its conditional and Range headers.
  * @param filepath The path of the file to be served.
- * @param filesize The size of the file in bytes.
+ * @param st The file's metadata: its size and validators.
+ * @param variant The file's encoding (a sidecar) and whether the response varies on Accept-Encoding.
  */
-void serve_file(int clientfd, const char *filepath, off_t filesize)
+void serve_file(Connection *conn, struct HTTPRequest *rq, const char *filepath, const struct stat *st,
+                const DocVariant *variant)
 {
-    FILE *file = fopen(filepath, "rb");
+    char etag[FILE_CACHE_ETAG_LEN];
+    int etag_len = file_etag(filepath, st, variant->encoding, etag, sizeof(etag));
+    if (not_modified(rq, etag, (size_t)etag_len, st->st_mtim.tv_sec))
+    {
+        send_not_modified(conn, filepath, etag, (size_t)etag_len, st->st_mtim.tv_sec, variant->vary);
+        return;
+    }
+
+    uint64_t queued = conn->queued_bytes;
+    int file_fd = open(filepath, O_RDONLY | O_CLOEXEC);
 
-    if (file == NULL)
+    if (file_fd < 0)
     {
-        printf("Failed to open file: %s\n", filepath);
-        send_error_response(filepath, clientfd, 500);
+        LOG(LOG_WARN, "Failed to open file: %s", filepath);
+        send_error_response(filepath, conn, 500);
         return;
     }
 
-    const char *mime_type = get_mime_type(filepath);
-    char header[PATH_LEN];
+    // same header the file cache would have prepared
+    char *header = NULL;
+    int header_len = file_header(filepath, st, (size_t)st->st_size, variant->encoding, &header);
 
-    char *file_name = strrchr(filepath, '/');
-    if (file_name)
+    // the fd is ours, so the last range queued closes it
+    BodySource body = {NULL, file_fd, 0, (uint64_t)st->st_size, NULL, NULL};
+    if (header_len >= 0 && variant->encoding == ENCODING_IDENTITY &&
+        serve_ranges(conn, rq, filepath, header, (size_t)header_len, &body, etag, (size_t)etag_len,
+                     st->st_mtim.tv_sec, variant->vary))
     {
-        file_name++; // skip the slash itself to get just file name
+        free(header);
+        return;
     }
-    else
+
+    char conn_headers[128];
+    connection_headers(conn, conn_headers, sizeof(conn_headers));
+
+    // queue header; it is corked with MSG_MORE so it shares a packet with the body
+    if (header_len < 0 || conn_write(conn, header, (size_t)header_len) < 0 ||
+        conn_printf(conn, "%s%s\r\n", variant->vary ? VARY_HEADER : "", conn_headers) < 0)
+    {
+        fail_response(conn);
+        free(header);
+        close(file_fd);
+        return;
+    }
+    free(header);
+
+    // body is sent straight from the file by the event loop (which closes the fd even on failure)
+    if (conn_attach_file(conn, file_fd, 0, st->st_size) < 0)
+    {
+        fail_response(conn);
+        return;
+    }
+    // formatted later on the log thread
+    log_request(conn->fd, "GET", filepath, 200, conn->queued_bytes - queued, conn->enqueued_ns);
+}
+
+/**
+ * @brief Formats a time as an HTTP date (IMF-fixdate), e.g. for Last-Modified.
+ *
+ * @param when The time.
+ * @param out Receives the date.
+ * @param size Size of out (HTTP_DATE_LEN is enough).
+ */
+void http_date(time_t when, char *out, size_t size)
+{
+    struct tm tm;
+    gmtime_r(&when, &tm);
+    strftime(out, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Queues a cached file: its prepared header, this connection's headers
+ *        and the body. A body in memory is sent from the cache without being
+ *        copied, in the same gathered write as the headers; a large file is
+ *        sent from the cache's fd with sendfile(). A revalidation the entry's
+ *        validators satisfy gets a 304 instead, a Range request a 206 or 416.
+ *
+ * @param conn The client connection.
+ * @param rq The parsed request, for its conditional and Range headers.
+ * @param file The cache entry; the reference passes to the connection.
+ * @param vary Non-zero if the response varies on Accept-Encoding.
+ */
+void serve_cached(Connection *conn, HTTPRequest *rq, CachedFile *file, int vary)
+{
+    size_t etag_len = strlen(file->etag);
+    if (not_modified(rq, file->etag, etag_len, file->mtime.tv_sec))
     {
-        file_name = (char *)filepath; // fallback if no slashes found
+        send_not_modified(conn, file->path, file->etag, etag_len, file->mtime.tv_sec, vary);
+        file_cache_release(file);
+        return;
     }
 
-    // build header
-    sprintf(header, "HTTP/1.1 200 OK\r\n"
-                    "File-Name: %s\r\n"
-                    "Content-Length: %ld\r\n"
-                    "Content-Type: %s\r\n"
-                    "\r\n",
-            file_name, filesize, mime_type);
+    // a gzip variant or sidecar is sent whole; ranges are only served of the file itself
+    BodySource body = {file->body, file->fd, 0, file->size, file_cache_release, file};
+    if (file->encoding == ENCODING_IDENTITY && serve_ranges(conn, rq, file->path, file->header, file->header_len,
+                                                            &body, file->etag, etag_len, file->mtime.tv_sec, vary))
+        return;
 
-    // send header
-    if (send(clientfd, header, strlen(header), 0) == -1)
+    uint64_t queued = conn->queued_bytes;
+    char conn_headers[128];
+    connection_headers(conn, conn_headers, sizeof(conn_headers));
+
+    if (conn_write(conn, file->header, file->header_len) < 0 ||
+        conn_printf(conn, "%s%s\r\n", vary ? VARY_HEADER : "", conn_headers) < 0)
     {
-        printf(" - ❌ Error: failed to send header\n");
-        fclose(file);
+        fail_response(conn);
+        file_cache_release(file);
         return;
     }
 
-    // send body
-    char file_buffer[BUFFER_SIZE];
-    size_t bytes_read;
-    while ((bytes_read = fread(file_buffer, 1, sizeof(file_buffer), file)) > 0)
+    // the segment holds the reference until the body is sent, so file stays valid for the log
+    if (queue_range(conn, &body, 0, file->size, 1) < 0)
     {
-        if (send(clientfd, file_buffer, bytes_read, 0) == -1)
+        fail_response(conn);
+        return;
+    }
+    log_request(conn->fd, "GET", file->path, 200, conn->queued_bytes - queued, conn->enqueued_ns);
+}
+
+/**
+ * @brief Queues a file from the pack: its prepared header straight from the
+ *        mapping, this connection's headers, then the body. Small bodies go out
+ *        from the mapping in the same gathered write as the headers; large ones
+ *        are sent from the pack's fd with sendfile(). Nothing is copied or opened.
+ *        Revalidations and Range requests are answered from the entry as for a
+ *        cached file.
+ *
+ * @param conn The client connection.
+ * @param rq The parsed request, for its conditional and Range headers.
+ * @param entry The pack entry.
+ * @param filepath The file it was built from, for the log.
+ */
+void serve_packed(Connection *conn, HTTPRequest *rq, const PackEntry *entry, const char *filepath)
+{
+    const char *etag = pack_at(entry->etag_offset);
+    if (not_modified(rq, etag, entry->etag_len, (time_t)entry->mtime))
+    {
+        send_not_modified(conn, filepath, etag, entry->etag_len, (time_t)entry->mtime, (int)entry->vary);
+        return;
+    }
+
+    void *owner = (void *)entry; // pack bytes are never released; the owner only marks them borrowed
+    BodySource body = {entry->body_len >= PACK_SENDFILE_MIN ? NULL : pack_at(entry->body_offset), pack_fd(),
+                       (off_t)entry->body_offset, entry->body_len, pack_release, owner};
+    if (entry->encoding == ENCODING_IDENTITY &&
+        serve_ranges(conn, rq, filepath, pack_at(entry->header_offset), entry->header_len, &body, etag,
+                     entry->etag_len, (time_t)entry->mtime, (int)entry->vary))
+        return;
+
+    uint64_t queued = conn->queued_bytes;
+    char conn_headers[128];
+    connection_headers(conn, conn_headers, sizeof(conn_headers));
+
+    if (conn_attach_memory(conn, pack_at(entry->header_offset), entry->header_len, pack_release, owner) < 0 ||
+        conn_printf(conn, "%s%s\r\n", entry->vary ? VARY_HEADER : "", conn_headers) < 0 ||
+        queue_range(conn, &body, 0, entry->body_len, 1) < 0)
+    {
+        fail_response(conn);
+        return;
+    }
+    log_request(conn->fd, "GET", filepath, 200, conn->queued_bytes - queued, conn->enqueued_ns);
+}
+
+/**
+ * @brief Reads the encodings a client accepts from its Accept-Encoding header,
+ *        e.g. "gzip, deflate, br;q=0.9, zstd". Codings with q=0 are refused,
+ *        "*" accepts every coding not named otherwise. The file itself
+ *        (identity) is always acceptable.
+ *
+ * @param header The Accept-Encoding value, or NULL if the client sent none.
+ * @return One bit (1 << ContentEncoding) per accepted encoding.
+ */
+unsigned accepted_encodings(const Slice *header)
+{
+    unsigned accepted = 1u << ENCODING_IDENTITY;
+    unsigned refused = 0;
+    int any = 0;
+    if (header == NULL)
+        return accepted;
+
+    const char *p = header->ptr;
+    const char *end = header->ptr + header->len;
+    while (p < end)
+    {
+        // one element: coding [; params], up to the next comma
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        const char *name = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+            p++;
+        size_t name_len = (size_t)(p - name);
+
+        const char *element_end = memchr(p, ',', (size_t)(end - p));
+        if (element_end == NULL)
+            element_end = end;
+
+        // "q=0", "q=0.0" and so on refuse the coding; any other weight accepts it
+        int zero_q = 0;
+        const char *param = p;
+        while ((param = memchr(param, ';', (size_t)(element_end - param))) != NULL)
+        {
+            param++;
+            while (param < element_end && (*param == ' ' || *param == '\t'))
+                param++;
+            if (param + 2 < element_end && (*param == 'q' || *param == 'Q') && param[1] == '=')
+            {
+                const char *digit = param + 2;
+                zero_q = *digit == '0';
+                for (digit++; zero_q && digit < element_end && *digit != ' ' && *digit != ';'; digit++)
+                    zero_q = *digit == '.' || *digit == '0';
+            }
+        }
+        p = element_end;
+
+        int encoding = -1;
+        if ((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) ||
+            (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0))
+            encoding = ENCODING_GZIP;
+        else if (name_len == 4 && strncasecmp(name, "zstd", 4) == 0)
+            encoding = ENCODING_ZSTD;
+        else if (name_len == 2 && strncasecmp(name, "br", 2) == 0)
+            encoding = ENCODING_BR;
+        else if (name_len == 1 && *name == '*')
+            any = !zero_q;
+
+        if (encoding > 0)
+        {
+            if (zero_q)
+                refused |= 1u << encoding;
+            else
+                accepted |= 1u << encoding;
+        }
+    }
+
+    if (any)
+        accepted |= (1u << NUM_ENCODINGS) - 1;
+    return accepted & ~refused;
+}
+
+/**
+ * @brief Evaluates a request's validators against the file it asks for. As in
+ *        RFC 9110, If-None-Match is used when present and If-Modified-Since is
+ *        ignored then.
+ *
+ * @param rq The parsed request.
+ * @param etag The file's ETag, quoted.
+ * @param etag_len Its length.
+ * @param mtime The file's modification time.
+ * @return 1 if the client's copy is current and a 304 answers it, 0 otherwise.
+ */
+int not_modified(HTTPRequest *rq, const char *etag, size_t etag_len, time_t mtime)
+{
+    const Slice *match = request_header(rq, HEADER_IF_NONE_MATCH);
+    if (match != NULL)
+        return etag_matches(*match, etag, etag_len);
+
+    const Slice *since = request_header(rq, HEADER_IF_MODIFIED_SINCE);
+    time_t date;
+    return since != NULL && parse_http_date(*since, &date) == 0 && mtime <= date;
+}
+
+/**
+ * @brief Answers a conditional request whose copy is current: a header-only
+ *        304 with the file's validators, so the client keeps its body.
+ *
+ * @param conn The client connection.
+ * @param filepath The file, for the log.
+ * @param etag The file's ETag, quoted.
+ * @param etag_len Its length.
+ * @param mtime The file's modification time.
+ * @param vary Non-zero if the 200 would carry Vary: Accept-Encoding.
+ */
+void send_not_modified(Connection *conn, const char *filepath, const char *etag, size_t etag_len, time_t mtime,
+                       int vary)
+{
+    uint64_t queued = conn->queued_bytes;
+    char conn_headers[128];
+    char modified[HTTP_DATE_LEN];
+    connection_headers(conn, conn_headers, sizeof(conn_headers));
+    http_date(mtime, modified, sizeof(modified));
+
+    // a 304 never has a body, so the connection stays usable without Content-Length
+    if (conn_printf(conn, "HTTP/1.1 304 Not Modified\r\n"
+                          "ETag: %.*s\r\n"
+                          "Last-Modified: %s\r\n"
+                          "%s%s\r\n",
+                    (int)etag_len, etag, modified, vary ? VARY_HEADER : "", conn_headers) < 0)
+    {
+        fail_response(conn);
+        return;
+    }
+    log_request(conn->fd, "GET", filepath, 304, conn->queued_bytes - queued, conn->enqueued_ns);
+}
+
+/**
+ * @brief Checks an If-None-Match value, e.g. "\"a\", W/\"b\"" or "*", against
+ *        an ETag. Uses the weak comparison If-None-Match calls for, so a W/
+ *        prefix is ignored.
+ *
+ * @param header The If-None-Match value.
+ * @param etag The file's ETag, quoted.
+ * @param etag_len Its length.
+ * @return 1 if one of the listed tags (or "*") matches, 0 otherwise.
+ */
+int etag_matches(Slice header, const char *etag, size_t etag_len)
+{
+    const char *p = header.ptr;
+    const char *end = header.ptr + header.len;
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        if (p < end && *p == '*')
+            return 1;
+        if (end - p >= 2 && p[0] == 'W' && p[1] == '/')
+            p += 2;
+
+        // a quoted tag runs to its closing quote; commas may appear inside it
+        const char *tag = p;
+        if (p < end && *p == '"')
+        {
+            const char *close = memchr(p + 1, '"', (size_t)(end - p - 1));
+            p = close != NULL ? close + 1 : end;
+        }
+        while (p < end && *p != ',')
+            p++;
+        const char *tag_end = p;
+        while (tag_end > tag && (tag_end[-1] == ' ' || tag_end[-1] == '\t'))
+            tag_end--;
+        if ((size_t)(tag_end - tag) == etag_len && memcmp(tag, etag, etag_len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parses an HTTP date in any of the three forms RFC 9110 requires a
+ *        recipient to accept: IMF-fixdate, RFC 850 and asctime().
+ *
+ * @param value The header value.
+ * @param when Receives the time.
+ * @return 0 on success, -1 if it is not a date.
+ */
+int parse_http_date(Slice value, time_t *when)
+{
+    static const char *const formats[] = {"%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT",
+                                          "%a %b %e %H:%M:%S %Y"};
+    char text[64];
+    if (value.len >= sizeof(text))
+        return -1;
+    memcpy(text, value.ptr, value.len);
+    text[value.len] = '\0';
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char *rest = strptime(text, formats[i], &tm);
+        if (rest != NULL && *rest == '\0')
+        {
+            *when = timegm(&tm);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Answers a Range request for a file whose 200 header is prepared. One
+ *        range gets a 206 with the body sent from its offset, several get a
+ *        multipart/byteranges 206 with each part sent from the body the same
+ *        way, and ranges that all lie past the end get a 416. The entity headers
+ *        are those of the 200, less the ones a partial response replaces.
+ *
+ * @param conn The client connection.
+ * @param rq The parsed request.
+ * @param filepath The file, for the log.
+ * @param header The file's prepared 200 header.
+ * @param header_len Its length.
+ * @param body Where the body is sent from; released here when a response is queued (or fails).
+ * @param etag The file's ETag, for If-Range.
+ * @param etag_len Its length.
+ * @param mtime The file's modification time, for If-Range.
+ * @param vary Non-zero if the response varies on Accept-Encoding.
+ * @return 1 if a 206 or 416 was queued, or failed part way and the connection
+ *         is to be closed; 0 if the whole file should be sent (no Range, a stale
+ *         If-Range, or a Range not worth honoring).
+ */
+int serve_ranges(Connection *conn, HTTPRequest *rq, const char *filepath, const char *header, size_t header_len,
+                 const BodySource *body, const char *etag, size_t etag_len, time_t mtime, int vary)
+{
+    const Slice *range = request_header(rq, HEADER_RANGE);
+    if (range == NULL || !if_range_matches(rq, etag, etag_len, mtime))
+        return 0;
+
+    ByteRange ranges[MAX_RANGES];
+    int count = parse_ranges(*range, body->size, ranges, MAX_RANGES);
+    if (count == 0)
+        return 0;
+
+    uint64_t queued = conn->queued_bytes;
+    char conn_headers[128];
+    connection_headers(conn, conn_headers, sizeof(conn_headers));
+    if (count < 0)
+    {
+        drop_body(body);
+        if (conn_printf(conn, "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                              "Content-Range: bytes */%llu\r\n"
+                              "Content-Length: 0\r\n"
+                              "%s%s\r\n",
+                        (unsigned long long)body->size, vary ? VARY_HEADER : "", conn_headers) < 0)
+        {
+            fail_response(conn);
+            return 1;
+        }
+        log_request(conn->fd, "GET", filepath, 416, conn->queued_bytes - queued, conn->enqueued_ns);
+        return 1;
+    }
+
+    // the 200's entity headers without its status line and length; several parts also replace its type
+    const char *type = "application/octet-stream";
+    int type_len = (int)strlen(type);
+    int failed = conn_printf(conn, "HTTP/1.1 206 Partial Content\r\n") < 0;
+    const char *line = memchr(header, '\n', header_len);
+    const char *end = header + header_len;
+    for (line = line != NULL ? line + 1 : end; line < end && !failed;)
+    {
+        const char *next = memchr(line, '\n', (size_t)(end - line));
+        next = next != NULL ? next + 1 : end;
+        size_t line_len = (size_t)(next - line);
+        if (line_len > 14 && strncasecmp(line, "Content-Type: ", 14) == 0)
+        {
+            const char *type_end = next;
+            while (type_end > line + 14 && (type_end[-1] == '\n' || type_end[-1] == '\r'))
+                type_end--;
+            type = line + 14;
+            type_len = (int)(type_end - type);
+            if (count == 1)
+                failed = conn_write(conn, line, line_len) < 0;
+        }
+        else if (line_len < 15 || strncasecmp(line, "Content-Length:", 15) != 0)
+        {
+            failed = conn_write(conn, line, line_len) < 0;
+        }
+        line = next;
+    }
+
+    // from the status line on, a failure must not leave a short 206 to be sent; the last range
+    // hands the body over even when queuing it fails, before that it is still ours to drop
+    if (count == 1)
+    {
+        uint64_t len = ranges[0].last - ranges[0].first + 1;
+        if (failed || conn_printf(conn, "Content-Length: %llu\r\n"
+                                        "Content-Range: bytes %llu-%llu/%llu\r\n"
+                                        "%s%s\r\n",
+                                  (unsigned long long)len, (unsigned long long)ranges[0].first,
+                                  (unsigned long long)ranges[0].last, (unsigned long long)body->size,
+                                  vary ? VARY_HEADER : "", conn_headers) < 0)
+        {
+            drop_body(body);
+            fail_response(conn);
+            return 1;
+        }
+        if (queue_range(conn, body, ranges[0].first, len, 1) < 0)
+        {
+            fail_response(conn);
+            return 1;
+        }
+        log_request(conn->fd, "GET", filepath, 206, conn->queued_bytes - queued, conn->enqueued_ns);
+        return 1;
+    }
+
+    // each part: a delimiter and its own headers, then its bytes; the length covers all of it
+    static const char part_format[] = "\r\n--%s\r\nContent-Type: %.*s\r\nContent-Range: bytes %llu-%llu/%llu\r\n\r\n";
+    char boundary[24];
+    snprintf(boundary, sizeof(boundary), "%016llx", (unsigned long long)(conn->enqueued_ns ^ body->size));
+    uint64_t total = strlen("\r\n----\r\n") + strlen(boundary);
+    for (int i = 0; i < count; i++)
+    {
+        total += (uint64_t)snprintf(NULL, 0, part_format, boundary, type_len, type,
+                                    (unsigned long long)ranges[i].first, (unsigned long long)ranges[i].last,
+                                    (unsigned long long)body->size);
+        total += ranges[i].last - ranges[i].first + 1;
+    }
+    failed = failed || conn_printf(conn, "Content-Type: multipart/byteranges; boundary=%s\r\n"
+                                         "Content-Length: %llu\r\n"
+                                         "%s%s\r\n",
+                                   boundary, (unsigned long long)total, vary ? VARY_HEADER : "", conn_headers) < 0;
+    int body_given = 0;
+    for (int i = 0; i < count && !failed; i++)
+    {
+        failed = conn_printf(conn, part_format, boundary, type_len, type, (unsigned long long)ranges[i].first,
+                             (unsigned long long)ranges[i].last, (unsigned long long)body->size) < 0;
+        if (!failed)
         {
-            printf(" - ❌ Error: failed to send file content\n");
-            send_error_response(filepath, clientfd, 500);
+            body_given = i == count - 1;
+            failed = queue_range(conn, body, ranges[i].first, ranges[i].last - ranges[i].first + 1, body_given) < 0;
+        }
+    }
+    if (failed || conn_printf(conn, "\r\n--%s--\r\n", boundary) < 0)
+    {
+        if (!body_given)
+            drop_body(body);
+        fail_response(conn);
+        return 1;
+    }
+    log_request(conn->fd, "GET", filepath, 206, conn->queued_bytes - queued, conn->enqueued_ns);
+    return 1;
+}
+
+/**
+ * @brief Queues part of a body from wherever it lives: memory, a borrowed fd,
+ *        or an fd of this response's own. Only the last range of a response
+ *        gives the body back (or closes the fd); earlier ones are sent before
+ *        it, so they are covered by that.
+ *
+ * @param conn The client connection.
+ * @param body Where the body is sent from.
+ * @param start Offset of the range in the body.
+ * @param len Its length.
+ * @param last Non-zero for the response's last range; it gives the body back even on failure.
+ * @return 0 on success, -1 on failure.
+ */
+int queue_range(Connection *conn, const BodySource *body, uint64_t start, uint64_t len, int last)
+{
+    if (body->data != NULL)
+        return conn_attach_memory(conn, body->data + start, len, last ? body->release : hold_body, body->owner);
+    if (body->release != NULL)
+        return conn_attach_shared_file(conn, body->fd, body->offset + (off_t)start, (off_t)len,
+                                       last ? body->release : hold_body, body->owner);
+
+    // the fd is ours: every earlier range sends from a duplicate that closes with it
+    int fd = last ? body->fd : dup(body->fd);
+    if (fd < 0)
+        return -1;
+    if (len == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    return conn_attach_file(conn, fd, body->offset + (off_t)start, (off_t)len);
+}
+
+/**
+ * @brief Gives a body back without sending any of it.
+ *
+ * @param body Where the body would have been sent from.
+ */
+void drop_body(const BodySource *body)
+{
+    if (body->release != NULL)
+        body->release(body->owner);
+    else
+        close(body->fd);
+}
+
+/**
+ * @brief Release callback for every range of a body but the last: the body
+ *        stays with its owner until the last range is released.
+ *
+ * @param owner What holds the body.
+ */
+void hold_body(void *owner)
+{
+    (void)owner;
+}
+
+/**
+ * @brief Gives up on a response that could not be queued whole. The event loop
+ *        closes the connection instead of flushing it, so the client never takes
+ *        a truncated body (or a missing response) for a complete one.
+ *
+ * @param conn The client connection.
+ */
+void fail_response(Connection *conn)
+{
+    LOG(LOG_ERROR, " - ❌ Error: failed to queue a response on fd %d, closing the connection", conn->fd);
+    conn->keep_alive = 0;
+    conn->failed = 1;
+}
+
+/**
+ * @brief Parses a Range header, e.g. "bytes=0-499, 1000-, -200", against the
+ *        size of a body. Ranges starting past the end are dropped, the rest are
+ *        clamped to it.
+ *
+ * @param header The Range value.
+ * @param size The body's size.
+ * @param ranges Receives the satisfiable ranges, in the order asked for.
+ * @param max Capacity of ranges.
+ * @return The number of ranges, -1 if none is satisfiable, or 0 to send the
+ *         whole body: the header is malformed, not in bytes, asks for more than
+ *         max ranges or for more bytes in total than the body has.
+ */
+int parse_ranges(Slice header, uint64_t size, ByteRange *ranges, int max)
+{
+    const char *p = header.ptr;
+    const char *end = header.ptr + header.len;
+    if (header.len < 6 || strncasecmp(p, "bytes=", 6) != 0)
+        return 0;
+
+    int count = 0;
+    int asked = 0;
+    uint64_t total = 0;
+    for (p += 6; p < end;)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        if (p == end)
             break;
+
+        // "first-last", "first-" or "-suffix"
+        uint64_t first = 0, last = 0;
+        int has_first = 0, has_last = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++, has_first = 1)
+        {
+            if (first > (UINT64_MAX - 9) / 10)
+                return 0;
+            first = first * 10 + (uint64_t)(*p - '0');
+        }
+        if (p == end || *p != '-')
+            return 0;
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, has_last = 1)
+        {
+            if (last > (UINT64_MAX - 9) / 10)
+                return 0;
+            last = last * 10 + (uint64_t)(*p - '0');
+        }
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if ((!has_first && !has_last) || (p < end && *p != ',') || (has_first && has_last && last < first) ||
+            ++asked > max)
+            return 0;
+
+        if (!has_first)
+        {
+            if (last == 0 || size == 0)
+                continue; // an empty suffix is not satisfiable
+            first = last < size ? size - last : 0;
+            last = size - 1;
         }
+        else if (first >= size)
+        {
+            continue;
+        }
+        else if (!has_last || last >= size)
+        {
+            last = size - 1;
+        }
+
+        // overlapping ranges could ask for a body many times over; those get the body once instead
+        total += last - first + 1;
+        if (total > size)
+            return 0;
+        ranges[count].first = first;
+        ranges[count].last = last;
+        count++;
     }
+    return count > 0 ? count : asked > 0 ? -1 : 0;
+}
+
+/**
+ * @brief Checks If-Range: a Range is only honored while the client's copy is
+ *        still the current file, named by a strong ETag or by its exact date.
+ *
+ * @param rq The parsed request.
+ * @param etag The file's ETag, quoted.
+ * @param etag_len Its length.
+ * @param mtime The file's modification time.
+ * @return 1 if there is no If-Range or it matches, 0 if the whole file must be sent.
+ */
+int if_range_matches(HTTPRequest *rq, const char *etag, size_t etag_len, time_t mtime)
+{
+    const Slice *condition = request_header(rq, HEADER_IF_RANGE);
+    if (condition == NULL)
+        return 1;
+    if (condition->len > 0 && (condition->ptr[0] == '"' || condition->ptr[0] == 'W'))
+        return condition->len == etag_len && memcmp(condition->ptr, etag, etag_len) == 0; // W/ never matches
 
-    fclose(file);
-    log_request(clientfd, "GET", (char *)filepath, 200); // safely prints here instead
+    time_t date;
+    return parse_http_date(*condition, &date) == 0 && date == mtime;
 }
 
-// --- HELPER FUNCTIONS ---
 /**
  * @brief Determines the MIME type based on the file extension.
  *
@@ -546,35 +1534,19 @@ const char *get_mime_type(const char *filepath)
     return "application/octet-stream"; // fallback
 }
 
-/**
- * @brief Deletes all headers in the HTTPHeader hash table.
- *
- * @param headers Pointer to the pointer of the head of the HTTPHeader hash table.
- */
-void delete_all_headers(HTTPHeader **headers)
-{
-    HTTPHeader *current_header, *tmp;
-
-    HASH_ITER(hh, *headers, current_header, tmp)
-    {
-        HASH_DEL(*headers, current_header);
-        free(current_header);
-    }
-}
-
 /**
  * @brief Returns whether or not the passed method is a supported HTTP
  *        method or not
- * @param method Pointer to the string containing the method
+ * @param method The method token of the request line
  */
-int is_valid_method(char *method)
+int is_valid_method(Slice method)
 {
-    const char *methods = {"GET"}; // supported http verbs
-    int i;
+    const char *methods[] = {"GET"}; // supported http verbs
+    size_t i;
 
-    for (i = 0; i < (sizeof(*methods) / sizeof(methods[i])); i++)
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++)
     {
-        if (strcmp(&(methods[i]), method) == 0)
+        if (slice_equals(method, methods[i]))
         {
             return 1;
         }
@@ -585,19 +1557,77 @@ int is_valid_method(char *method)
 /**
  * @brief Returns whether or not the passed version is one of the 
  *        HTTP versions we support
- * @param version Pointer to the string containing the verison
+ * @param version The version token of the request line
  */
-int is_valid_version(char *version)
+int is_valid_version(Slice version)
 {
-    const char *versions = {"HTTP/1.1"}; // supported versions
-    int i;
+    const char *versions[] = {"HTTP/1.1"}; // supported versions
+    size_t i;
 
-    for (i = 0; i < (sizeof(*versions) / sizeof(versions[i])); i++)
+    for (i = 0; i < sizeof(versions) / sizeof(versions[0]); i++)
     {
-        if (strcmp(&(versions[i]), version) == 0)
+        if (slice_equals(version, versions[i]))
         {
             return 1;
         }
     }
     return 0;
 }
+
+/**
+ * @brief Turns a span recorded by the parser into a view of the receive buffer.
+ *
+ * @param buffer The receive buffer the span points into.
+ * @param span The byte range.
+ * @return The slice covering the span.
+ */
+Slice span_slice(const char *buffer, Span span)
+{
+    Slice slice = {buffer + span.off, span.len};
+    return slice;
+}
+
+/**
+ * @brief Compares a slice with a null terminated string.
+ *
+ * @param slice The slice to compare.
+ * @param text The expected contents.
+ * @return 1 if they hold the same bytes, 0 otherwise.
+ */
+int slice_equals(Slice slice, const char *text)
+{
+    return strlen(text) == slice.len && memcmp(slice.ptr, text, slice.len) == 0;
+}
+
+/**
+ * @brief Maps a header name to the known header it names, ignoring case.
+ *        The generated perfect hash gives the only slot the name can be in,
+ *        so one comparison settles it.
+ *
+ * @param key The header name.
+ * @return The header's id, or HEADER_OTHER if it is not in known_headers.txt.
+ */
+KnownHeader classify_header(Slice key)
+{
+    const KnownHeaderSlot *slot = &known_header_table[header_slot(key.ptr, key.len)];
+
+    if (slot->len == key.len && strncasecmp(slot->name, key.ptr, key.len) == 0)
+    {
+        return (KnownHeader)slot->id;
+    }
+    return HEADER_OTHER;
+}
+
+/**
+ * @brief Looks up a known header of the request.
+ *
+ * @param rq The parsed request.
+ * @param id Which header to find.
+ * @return The header's value, or NULL if the client did not send it.
+ */
+const Slice *request_header(HTTPRequest *rq, KnownHeader id)
+{
+    if (rq->known[id] == 0)
+        return NULL;
+    return &rq->headers[rq->known[id] - 1].value;
+}
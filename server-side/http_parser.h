@@ -8,13 +8,25 @@
 #define HTTP_PARSER_H
 
 #include "server.h"
+#include "connection.h"
+#include "docroot.h"
 
-#define BUFFER_SIZE 1024
+#include <sys/stat.h>
+#include <time.h>
 
-void send_error_response(const char *filepath, int clientfd, int status_code);
+#define HTTP_DATE_LEN 32 // "Sun, 06 Nov 1994 08:49:37 GMT" and its null
+
+struct HTTPRequest; // parsed request, private to http_parser.c
+
+void send_error_response(const char *filepath, Connection *conn, int status_code);
 const char *get_mime_type(const char *filepath);
-void handle_request(int clientfd, const char *buffer);
-void serve_file(int clientfd, const char *filepath, off_t filesize);
-ssize_t receive_message(int clientfd, char *buffer);
+void handle_request(Connection *conn);
+void serve_file(Connection *conn, struct HTTPRequest *rq, const char *filepath, const struct stat *st,
+                const DocVariant *variant);
+void http_date(time_t when, char *out, size_t size);
+ssize_t receive_message(Connection *conn);
+int parser_feed(RequestParser *parser, const char *buffer, size_t len);
+void parser_reset(RequestParser *parser);
+int request_ready(Connection *conn);
 
 #endif
\ No newline at end of file
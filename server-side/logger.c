@@ -0,0 +1,447 @@
+/**
+ * Summary: Asynchronous logger. A thread that logs copies a fixed-size record into its own
+ *          single-producer ring, with no lock, syscall or stdio on the way. A background writer
+ *          thread drains every ring each flush interval (or sooner, when a ring fills up), formats
+ *          the records and writes them to the log file in large batches. When a ring is full the
+ *          record is dropped and counted rather than making a worker wait.
+ *
+ * @file logger.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE
+
+#include "logger.h"
+#include "access_log.h"
+#include "work_queue.h" // CACHE_LINE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_LINE_MAX 512 // longest line format_record() produces
+
+// one thread's records; the owner only moves head, the writer only moves tail
+typedef struct LogRing
+{
+    LogRecord records[LOG_RING_SIZE];
+    size_t head __attribute__((aligned(CACHE_LINE)));
+    uint64_t dropped; // records lost because the ring was full
+    size_t tail __attribute__((aligned(CACHE_LINE)));
+    uint64_t reported; // dropped count already written to the log
+    unsigned long thread_id;
+    int exited; // owner is gone; freed once drained
+    struct LogRing *next;
+} LogRing;
+
+// --- LOGGING GLOBALS ---
+int log_level = LOG_INFO;
+int log_fd = -1;          // -1 until logger_init(), messages go straight to stdout before that
+int log_flush_ms = DEFAULT_LOG_FLUSH_MS;
+uint32_t log_wake_word = 0; // futex the writer sleeps on between flushes
+
+pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER; // guards the ring list (not the rings)
+LogRing *rings = NULL;
+pthread_key_t ring_key;
+__thread LogRing *thread_ring = NULL;
+
+// --- FUNCTION DECLERATIONS ---
+int logger_init(const char *path, int flush_ms);
+int log_level_parse(const char *name);
+void log_printf(LogLevel level, const char *fmt, ...);
+void log_request(int client_fd, const char *method, const char *filepath, int status, uint64_t bytes,
+                 uint64_t started_ns);
+void *writer_function(void *arg);
+
+// --- HELPER FUNCTIONS ---
+LogRecord *reserve_record(LogRing **ring_out);
+void commit_record(LogRing *ring);
+LogRing *get_ring();
+void release_ring(void *arg);
+size_t drain_rings(char *batch, size_t len);
+size_t format_record(const LogRing *ring, const LogRecord *record, char *out, size_t size);
+size_t write_batch(const char *batch, size_t len);
+uint64_t realtime_ns();
+
+// --- FUNCTIONS ---
+/**
+ * @brief Opens the log and starts the writer thread. Until this is called
+ *        (and if it fails) messages are printed directly to stdout.
+ *
+ * @param path File to append the log to, or NULL for stdout.
+ * @param flush_ms Longest time a record waits in a ring before it is written.
+ * @return 0 on success, -1 on failure.
+ */
+int logger_init(const char *path, int flush_ms)
+{
+    int fd = STDOUT_FILENO;
+    if (path != NULL)
+    {
+        fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            perror(" - ❌ Error: could not open log file");
+            return -1;
+        }
+    }
+
+    if (pthread_key_create(&ring_key, release_ring) != 0)
+    {
+        fprintf(stderr, " - ❌ Error: could not create logger thread key\n");
+        return -1;
+    }
+
+    fflush(stdout); // whatever was printed before now goes out ahead of the batches
+    log_flush_ms = flush_ms > 0 ? flush_ms : DEFAULT_LOG_FLUSH_MS;
+    log_fd = fd;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_function, NULL) != 0)
+    {
+        fprintf(stderr, " - ❌ Error: could not start the log writer thread\n");
+        log_fd = -1;
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+/**
+ * @brief Turns a level name from the command line into a LogLevel.
+ *
+ * @param name "error", "warn", "info" or "debug".
+ * @return The level, or -1 if the name is unknown.
+ */
+int log_level_parse(const char *name)
+{
+    static const char *names[] = {"error", "warn", "info", "debug"};
+
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Logs a formatted message (without a trailing newline). Use the LOG()
+ *        macro so the level check happens before the arguments are evaluated.
+ *
+ * @param level Severity of the message.
+ * @param fmt printf-style format string.
+ */
+void log_printf(LogLevel level, const char *fmt, ...)
+{
+    if (!log_enabled(level))
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+
+    LogRing *ring;
+    LogRecord *record = reserve_record(&ring);
+    if (record == NULL)
+    {
+        if (log_fd < 0) // logger not started yet: print right away
+        {
+            vprintf(fmt, args);
+            putchar('\n');
+        }
+        va_end(args);
+        return;
+    }
+
+    record->level = level;
+    record->kind = LOG_RECORD_TEXT;
+    vsnprintf(record->text, sizeof(record->text), fmt, args);
+    va_end(args);
+    commit_record(ring);
+}
+
+/**
+ * @brief Logs one served request: a binary record in the access log (if one
+ *        was opened) and, at info level, a text line. The path is copied as is;
+ *        all formatting happens later on the writer thread.
+ *
+ * @param client_fd Socket file descriptor of the client being served
+ * @param method HTTP method used in the request (e.g., "GET")
+ * @param filepath Path of the requested resource
+ * @param status HTTP status code returned to the client (e.g., 200, 404, etc.)
+ * @param bytes Response bytes queued, headers included
+ * @param started_ns CLOCK_MONOTONIC time the connection was handed to the pool
+ */
+void log_request(int client_fd, const char *method, const char *filepath, int status, uint64_t bytes,
+                 uint64_t started_ns)
+{
+    access_log_request(client_fd, filepath, status, bytes, started_ns);
+
+    if (!log_enabled(LOG_INFO))
+        return;
+
+    LogRing *ring;
+    LogRecord *record = reserve_record(&ring);
+    if (record == NULL)
+    {
+        if (log_fd < 0)
+            printf("[Worker thread: %lu] %s %s -> Status: %d\n", pthread_self(), method, filepath, status);
+        return;
+    }
+
+    size_t path_len = strnlen(filepath, sizeof(record->text) - 1);
+    record->level = LOG_INFO;
+    record->kind = LOG_RECORD_REQUEST;
+    record->status = (int16_t)status;
+    record->fd = client_fd;
+    strncpy(record->method, method, sizeof(record->method) - 1);
+    record->method[sizeof(record->method) - 1] = '\0';
+    memcpy(record->text, filepath, path_len);
+    record->text[path_len] = '\0';
+    commit_record(ring);
+}
+
+/**
+ * @brief Writer thread: sleeps for the flush interval (or until a ring is
+ *        half full), then drains every ring and writes the batch.
+ *
+ * @param arg Unused.
+ */
+void *writer_function(void *arg)
+{
+    (void)arg;
+    char *batch = malloc(LOG_BATCH_SIZE);
+    if (batch == NULL)
+    {
+        perror(" - ❌ Error: failed to allocate log batch");
+        return NULL;
+    }
+
+    struct timespec interval = {log_flush_ms / 1000, (log_flush_ms % 1000) * 1000000L};
+    while (1)
+    {
+        uint32_t seen = __atomic_load_n(&log_wake_word, __ATOMIC_ACQUIRE);
+
+        size_t len = drain_rings(batch, 0);
+        write_batch(batch, len);
+
+        syscall(SYS_futex, &log_wake_word, FUTEX_WAIT_PRIVATE, seen, &interval, NULL, 0);
+    }
+    return NULL;
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Finds the next free record in the calling thread's ring.
+ *
+ * @param ring_out Receives the ring to pass to commit_record().
+ * @return The record to fill, or NULL if the logger is not running or the ring is full.
+ */
+LogRecord *reserve_record(LogRing **ring_out)
+{
+    if (log_fd < 0)
+        return NULL;
+
+    LogRing *ring = get_ring();
+    if (ring == NULL)
+        return NULL;
+
+    size_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE)
+    {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    LogRecord *record = &ring->records[head & (LOG_RING_SIZE - 1)];
+    record->time_ns = realtime_ns();
+    *ring_out = ring;
+    return record;
+}
+
+/**
+ * @brief Publishes the record filled after reserve_record(). Wakes the writer
+ *        early when the ring reaches half full, so bursts are not dropped.
+ *
+ * @param ring The calling thread's ring.
+ */
+void commit_record(LogRing *ring)
+{
+    size_t head = ring->head + 1;
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) == LOG_RING_SIZE / 2)
+    {
+        __atomic_fetch_add(&log_wake_word, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &log_wake_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * @brief Returns the calling thread's ring, creating and registering it on
+ *        the thread's first log call.
+ *
+ * @return The ring, or NULL if it could not be allocated.
+ */
+LogRing *get_ring()
+{
+    if (thread_ring != NULL)
+        return thread_ring;
+
+    LogRing *ring = aligned_alloc(CACHE_LINE, sizeof(LogRing));
+    if (ring == NULL)
+        return NULL;
+    memset(ring, 0, sizeof(LogRing));
+    ring->thread_id = (unsigned long)pthread_self();
+
+    pthread_mutex_lock(&rings_mutex);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_mutex);
+
+    pthread_setspecific(ring_key, ring);
+    thread_ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Thread exit hook: hands the ring to the writer, which frees it once
+ *        its last records are written.
+ *
+ * @param arg The exiting thread's ring.
+ */
+void release_ring(void *arg)
+{
+    LogRing *ring = (LogRing *)arg;
+    thread_ring = NULL;
+    __atomic_store_n(&ring->exited, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Formats every pending record into batch, writing the batch out
+ *        whenever it fills up, and frees the rings of exited threads.
+ *
+ * @param batch Buffer of LOG_BATCH_SIZE bytes.
+ * @param len Bytes already in batch.
+ * @return Bytes left in batch for the caller to write.
+ */
+size_t drain_rings(char *batch, size_t len)
+{
+    pthread_mutex_lock(&rings_mutex);
+
+    LogRing **link = &rings;
+    while (*link != NULL)
+    {
+        LogRing *ring = *link;
+        int exited = __atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE);
+        size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        size_t tail = ring->tail;
+
+        for (; tail != head; tail++)
+        {
+            if (len + LOG_LINE_MAX > LOG_BATCH_SIZE)
+                len = write_batch(batch, len);
+            len += format_record(ring, &ring->records[tail & (LOG_RING_SIZE - 1)],
+                                 batch + len, LOG_BATCH_SIZE - len);
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != ring->reported)
+        {
+            if (len + LOG_LINE_MAX > LOG_BATCH_SIZE)
+                len = write_batch(batch, len);
+            len += snprintf(batch + len, LOG_BATCH_SIZE - len,
+                            " - ⚠️ Warning: %lu log records dropped by thread %lu (ring full)\n",
+                            (unsigned long)(dropped - ring->reported), ring->thread_id);
+            ring->reported = dropped;
+        }
+
+        // the owner stores its last head before exited, so a drained exited ring stays empty
+        if (exited)
+        {
+            *link = ring->next;
+            free(ring);
+            continue;
+        }
+        link = &ring->next;
+    }
+
+    pthread_mutex_unlock(&rings_mutex);
+    return len;
+}
+
+/**
+ * @brief Formats one record as a text line.
+ *
+ * @param ring The ring it came from (for the thread id).
+ * @param record The record.
+ * @param out Where to write the line.
+ * @param size Space available in out (at least LOG_LINE_MAX).
+ * @return Length of the line.
+ */
+size_t format_record(const LogRing *ring, const LogRecord *record, char *out, size_t size)
+{
+    time_t seconds = (time_t)(record->time_ns / 1000000000ull);
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+
+    size_t len = strftime(out, size, "%Y-%m-%d %H:%M:%S", &tm);
+    int n;
+    if (record->kind == LOG_RECORD_REQUEST)
+    {
+        n = snprintf(out + len, size - len, ".%03u [Worker thread: %lu] %s %s -> Status: %d\n",
+                     (unsigned)(record->time_ns / 1000000 % 1000), ring->thread_id,
+                     record->method, record->text, record->status);
+    }
+    else
+    {
+        n = snprintf(out + len, size - len, ".%03u %s\n",
+                     (unsigned)(record->time_ns / 1000000 % 1000), record->text);
+    }
+
+    len += n > 0 ? (size_t)n : 0;
+    return len < size ? len : size - 1;
+}
+
+/**
+ * @brief Writes a batch to the log, retrying short writes.
+ *
+ * @param batch The formatted lines.
+ * @param len Their length.
+ * @return 0, the new length of the (now empty) batch.
+ */
+size_t write_batch(const char *batch, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = write(log_fd, batch + done, len - done);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break; // nowhere to report a failing log; drop the batch
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Current wall clock time in nanoseconds.
+ *
+ * @return Nanoseconds since the epoch.
+ */
+uint64_t realtime_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
@@ -0,0 +1,63 @@
+/**
+ * Summary: Header file for the asynchronous logger: per-thread lock-free rings of fixed-size
+ *          records, drained, formatted and written in batches by a background thread.
+ *
+ * @file logger.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_RING_SIZE 1024           // records per thread (power of two)
+#define LOG_TEXT_LEN 232             // message or path bytes kept per record
+#define LOG_BATCH_SIZE 65536         // bytes formatted before each write()
+#define DEFAULT_LOG_FLUSH_MS 100     // how often the writer thread drains the rings (-F)
+
+typedef enum LogLevel
+{
+    LOG_ERROR = 0,
+    LOG_WARN,
+    LOG_INFO, // one line per request (the default)
+    LOG_DEBUG // request dumps and path tracing
+} LogLevel;
+
+typedef enum LogKind
+{
+    LOG_RECORD_TEXT = 0, // text holds a formatted message
+    LOG_RECORD_REQUEST   // text holds the request path, formatted by the writer
+} LogKind;
+
+// one log entry, copied into a ring by the thread that logs it (256 bytes)
+typedef struct LogRecord
+{
+    uint64_t time_ns; // CLOCK_REALTIME
+    uint8_t level;
+    uint8_t kind;
+    int16_t status;
+    int32_t fd;
+    char method[8];
+    char text[LOG_TEXT_LEN];
+} LogRecord;
+
+// messages above this level are dropped before any formatting happens
+extern int log_level;
+#define log_enabled(level) ((int)(level) <= log_level)
+
+// checks the level first, so disabled messages do not even evaluate their arguments
+#define LOG(level, ...)                         \
+    do                                          \
+    {                                           \
+        if (log_enabled(level))                 \
+            log_printf((level), __VA_ARGS__);   \
+    } while (0)
+
+int logger_init(const char *path, int flush_ms);
+int log_level_parse(const char *name);
+void log_printf(LogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_request(int client_fd, const char *method, const char *filepath, int status, uint64_t bytes,
+                 uint64_t started_ns);
+
+#endif
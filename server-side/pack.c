@@ -0,0 +1,216 @@
+/**
+ * Summary: Document root pack. With -P the server maps one file built by ./mkpack instead of
+ *          indexing the document root: the URL index, each file's prepared response header and
+ *          its body all live in the mapping, so startup is one open() and mmap() and a request
+ *          touches no file at all. A request path is normalized as for the document root index
+ *          and looked up in the pack's own hash table; the header and small bodies are queued
+ *          straight from the mapping, large bodies are sent from the pack's fd with sendfile().
+ *          Precompressed sidecars are entries of their own under the URL they stand in for, so
+ *          Accept-Encoding is negotiated in the same probe. The pack is immutable: replacing it
+ *          means building a new one and restarting.
+ *
+ * @file pack.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#include "pack.h"
+#include "logger.h"
+#include "server.h" // PATH_LEN
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --- PACK GLOBALS ---
+const char *pack_map = NULL; // the whole pack, read only; NULL when serving the document root
+size_t pack_size = 0;
+int pack_file = -1;          // kept open for sendfile()
+const PackEntry *pack_index = NULL;
+uint64_t pack_slots = 0;
+
+// --- FUNCTION DECLERATIONS ---
+int pack_init(const char *path);
+int pack_active();
+DocResult pack_resolve(const char *url, size_t len, unsigned accepted, const PackEntry **entry, char *filepath,
+                       size_t size);
+const char *pack_at(uint64_t offset);
+int pack_fd();
+void pack_release(void *entry);
+
+// --- HELPER FUNCTIONS ---
+int pack_valid(const PackHeader *header, size_t size);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Maps a pack and checks its header and index.
+ *
+ * @param path The pack file.
+ * @return 0 on success, -1 if it cannot be mapped or is not a pack.
+ */
+int pack_init(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, " - ❌ Error: could not open pack %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *map = size >= sizeof(PackHeader) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED || !pack_valid((const PackHeader *)map, size))
+    {
+        fprintf(stderr, " - ❌ Error: %s is not a pack (version %d), build one with make pack\n", path,
+                PACK_VERSION);
+        if (map != MAP_FAILED)
+            munmap(map, size);
+        close(fd);
+        return -1;
+    }
+
+    // start reading the whole pack in now, so the first requests do not fault pages in one by one
+    madvise(map, size, MADV_WILLNEED);
+
+    const PackHeader *header = (const PackHeader *)map;
+    pack_map = (const char *)map;
+    pack_size = size;
+    pack_file = fd;
+    pack_index = (const PackEntry *)(pack_map + header->index_offset);
+    pack_slots = header->slots;
+    LOG(LOG_INFO, " - ✔️ Serving %u paths from pack %s (%zu KB)", header->count, path, size >> 10);
+    return 0;
+}
+
+/**
+ * @brief Tells whether requests are served from a pack.
+ *
+ * @return 1 after a successful pack_init(), 0 otherwise.
+ */
+int pack_active()
+{
+    return pack_map != NULL;
+}
+
+/**
+ * @brief Maps a request path to its entry in the pack: the file itself, or the
+ *        smallest of its sidecars the client accepts.
+ *
+ * @param url The request path as sent (not null terminated).
+ * @param len Its length.
+ * @param accepted Encodings the client accepts, one bit (1 << ContentEncoding) each.
+ * @param entry Receives the entry when found.
+ * @param filepath Receives the file the entry was built from; on a miss, the normalized path (for the log).
+ * @param size Size of filepath.
+ * @return DOC_FOUND, DOC_MISSING or DOC_INVALID.
+ */
+DocResult pack_resolve(const char *url, size_t len, unsigned accepted, const PackEntry **entry, char *filepath,
+                       size_t size)
+{
+    char normalized[PATH_LEN];
+    int normalized_len = normalize_path(url, len, normalized, sizeof(normalized));
+    if (normalized_len < 0)
+    {
+        snprintf(filepath, size, "invalid_path");
+        return DOC_INVALID;
+    }
+
+    // the file and its sidecars share a hash, so one probe sees all of them
+    const PackEntry *identity = NULL;
+    const PackEntry *encoded = NULL;
+    uint32_t hash = url_hash(normalized, (size_t)normalized_len);
+    for (uint64_t slot = hash & (pack_slots - 1); pack_index[slot].hash != 0; slot = (slot + 1) & (pack_slots - 1))
+    {
+        const PackEntry *candidate = &pack_index[slot];
+        if (candidate->hash != hash || candidate->url_len != (uint32_t)normalized_len ||
+            memcmp(pack_map + candidate->url_offset, normalized, (size_t)normalized_len) != 0)
+            continue;
+        if (candidate->encoding == ENCODING_IDENTITY)
+            identity = candidate;
+        else if (candidate->encoding < NUM_ENCODINGS && (accepted & (1u << candidate->encoding)) &&
+                 (encoded == NULL || candidate->body_len < encoded->body_len))
+            encoded = candidate;
+    }
+
+    if (identity == NULL)
+    {
+        snprintf(filepath, size, "pack:%s", normalized);
+        return DOC_MISSING;
+    }
+    *entry = encoded != NULL && encoded->body_len < identity->body_len ? encoded : identity;
+    snprintf(filepath, size, "%s", pack_map + (*entry)->path_offset);
+    return DOC_FOUND;
+}
+
+/**
+ * @brief Turns a pack offset into a pointer into the mapping.
+ *
+ * @param offset Offset from the start of the pack.
+ * @return The bytes at that offset.
+ */
+const char *pack_at(uint64_t offset)
+{
+    return pack_map + offset;
+}
+
+/**
+ * @brief The pack's open file, for sending large bodies with explicit offsets.
+ *
+ * @return The fd, or -1 without a pack.
+ */
+int pack_fd()
+{
+    return pack_file;
+}
+
+/**
+ * @brief Release callback for queued pack bytes. The mapping and fd live as
+ *        long as the server, so there is nothing to give back.
+ *
+ * @param entry The entry the bytes belong to.
+ */
+void pack_release(void *entry)
+{
+    (void)entry;
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Checks a mapped pack before anything in it is trusted: the header, the
+ *        index bounds, every entry's strings and body, and that the index has a free slot.
+ *
+ * @param header The start of the mapping.
+ * @param size Size of the mapping.
+ * @return 1 if it is a usable pack, 0 otherwise.
+ */
+int pack_valid(const PackHeader *header, size_t size)
+{
+    if (memcmp(header->magic, PACK_MAGIC, sizeof(header->magic)) != 0 || header->version != PACK_VERSION ||
+        header->size != size || header->slots == 0 || (header->slots & (header->slots - 1)) != 0 ||
+        header->count >= header->slots || header->index_offset % sizeof(uint64_t) != 0 ||
+        header->index_offset > size || header->slots > (size - header->index_offset) / sizeof(PackEntry))
+        return 0;
+
+    const char *base = (const char *)header;
+    const PackEntry *index = (const PackEntry *)(base + header->index_offset);
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < header->slots; i++)
+    {
+        const PackEntry *entry = &index[i];
+        if (entry->hash == 0)
+            continue;
+        if (entry->url_offset >= size || entry->url_len >= size - entry->url_offset ||
+            entry->path_offset >= size || entry->path_len >= size - entry->path_offset ||
+            entry->header_offset > size || entry->header_len > size - entry->header_offset ||
+            entry->etag_offset > size || entry->etag_len > size - entry->etag_offset ||
+            entry->body_offset > size || entry->body_len > size - entry->body_offset || entry->encoding >= NUM_ENCODINGS ||
+            base[entry->url_offset + entry->url_len] != '\0' || base[entry->path_offset + entry->path_len] != '\0')
+            return 0;
+        used++;
+    }
+    return used == header->count; // and so at least one empty slot ends every probe
+}
@@ -0,0 +1,64 @@
+/**
+ * Summary: Header file for the document root pack: one file holding every servable URL, its
+ *          prepared response header and the file body on its own pages, built by ./mkpack
+ *          (make pack) and served from a read-only mapping with -P. The layout is shared
+ *          with the builder.
+ *
+ * @file pack.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef PACK_H
+#define PACK_H
+
+#include "docroot.h" // DocResult
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACK_MAGIC "HTTPPAK1"
+#define PACK_VERSION 3
+#define PACK_ALIGN 4096                // every body starts on a page of its own
+#define PACK_SENDFILE_MIN (64 << 10)   // bodies this large go out with sendfile() from the pack's fd
+
+// start of the file; all offsets are from the start of the file
+typedef struct PackHeader
+{
+    char magic[8]; // PACK_MAGIC, not null terminated
+    uint32_t version;
+    uint32_t count;        // entries in the index (one per URL and encoding)
+    uint64_t slots;        // index slots (power of two)
+    uint64_t index_offset; // PackEntry[slots], open addressing by url_hash()
+    uint64_t size;         // whole file, checked against the file on load
+    uint64_t created_ns;   // CLOCK_REALTIME when the pack was built
+    uint8_t reserved[16];
+} PackHeader; // 64 bytes
+
+// one servable URL in one encoding; the strings are null terminated, aliases of a file share its body
+typedef struct PackEntry
+{
+    uint32_t hash; // 0 = empty slot
+    uint32_t url_len;
+    uint32_t path_len;
+    uint32_t header_len;
+    uint32_t encoding; // ContentEncoding; a URL's sidecars are entries of their own under the same URL
+    uint32_t vary;     // the URL has sidecars, so its responses vary on Accept-Encoding
+    uint64_t url_offset;    // normalized URL, e.g. "/css/site.css"
+    uint64_t path_offset;   // file it was built from, for the log
+    uint64_t header_offset; // same header the file cache prepares for the file
+    uint64_t body_offset;   // page aligned
+    uint64_t body_len;
+    uint64_t etag_offset;   // the file's ETag, quoted, for If-None-Match
+    uint32_t etag_len;
+    uint32_t reserved;
+    int64_t mtime;          // the file's mtime in seconds, for If-Modified-Since
+} PackEntry; // 88 bytes
+
+int pack_init(const char *path);
+int pack_active();
+DocResult pack_resolve(const char *url, size_t len, unsigned accepted, const PackEntry **entry, char *filepath,
+                       size_t size);
+const char *pack_at(uint64_t offset);
+int pack_fd();
+void pack_release(void *entry);
+
+#endif
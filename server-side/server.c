@@ -1,66 +1,339 @@
 /**
- * Summary: Main server entry point, responsible for socket creation, binding, listening, and the main accept loop.
+ * Summary: Main server entry point, responsible for socket creation, binding, listening, and starting the event loop.
  *
  * @file server.c
  * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
  */
 #include "thread_pool.h"
 #include "http_parser.h"
+#include "event_loop.h"
+#include "access_log.h"
+#include "compress.h"
+#include "docroot.h"
+#include "file_cache.h"
+#include "pack.h"
+#include "logger.h"
+#include "token_scan.h"
 
 #include <signal.h>
 #include <netdb.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #define PORT 6767
-#define NUM_CONNECTIONS 5
+
+// one listener + event loop + worker set; in sharded mode there is one per core
+typedef struct Shard
+{
+    EventLoop loop;
+    ThreadPool pool;
+    pthread_t thread;
+    CpuList cpus; // this shard's slice of -a, empty when not pinning
+} Shard;
+
+ServerOptions server_options = {0};
 
 // --- FUNCTION DECLERATIONS ---
-int welcome_socket(uint16_t port);
+void parse_options(int argc, char *argv[]);
+int start_shard(Shard *shard, int reuse_port, int min_threads, int max_threads);
+void *shard_function(void *arg);
+int welcome_socket(uint16_t port, int reuse_port);
 int create_socket(int *socketfd, int domain, int type);
-int set_socket_opt(int serverfd);
+int set_socket_opt(int serverfd, int reuse_port);
 int bind_socket(int serverfd, uint16_t port, struct sockaddr_in *server_addr,
                 socklen_t server_addr_len);
 int start_listening(int serverfd);
 
 // --- FUNCTIONS ---
-int main()
+int main(int argc, char *argv[])
 {
+    parse_options(argc, argv);
+
     // prevent crashes if a client disconnects abruptly
     signal(SIGPIPE, SIG_IGN);
 
-    // start the worker threads
-    thread_pool();
+    // pick the widest vector unit for the request parser before any thread uses it
+    token_scan_init();
+
+    // from here on workers log into their own rings; a background thread does the writing
+    if (logger_init(server_options.log_path, server_options.log_flush_ms) < 0)
+    {
+        return -1;
+    }
+
+    // binary per-request records, appended straight into a mapped file by the workers
+    if (server_options.access_log_path != NULL &&
+        access_log_init(server_options.access_log_path, (size_t)server_options.access_log_mb << 20) < 0)
+    {
+        return -1;
+    }
+
+    if (file_cache_init((size_t)server_options.file_cache_mb << 20, server_options.fd_cache_size) < 0)
+    {
+        fprintf(stderr, " - ❌ Error: could not set up the file cache\n");
+        return -1;
+    }
+    compress_init(server_options.compress_level);
+
+    // a pack holds every path and body already, otherwise every servable path is indexed up front;
+    // either way requests resolve without touching the disk
+    if (server_options.pack_path != NULL ? pack_init(server_options.pack_path) < 0
+                                         : docroot_init(server_options.docroot) < 0)
+    {
+        return -1;
+    }
+
+    // sharded mode: one SO_REUSEPORT listener per shard, the kernel spreads clients across them
+    int num_shards = 1;
+    int reuse_port = server_options.shards > 0;
+    if (reuse_port)
+    {
+        num_shards = server_options.shards;
+    }
+
+    // the worker limits are for the whole server, so they are split between the shards
+    int min_per_shard = (server_options.min_threads + num_shards - 1) / num_shards;
+    int max_per_shard = (server_options.max_threads + num_shards - 1) / num_shards;
+    Shard *shards = (Shard *)calloc(num_shards, sizeof(Shard));
+    if (shards == NULL)
+    {
+        perror("failed to allocate shards on the heap");
+        return -1;
+    }
+
+    for (int i = 0; i < num_shards; i++)
+    {
+        // set up each shard while running on its cores, so its loop's buffers are node-local
+        cpu_list_slice(&server_options.cpus, i, num_shards, &shards[i].cpus);
+        pin_self(&shards[i].cpus);
+
+        if (start_shard(&shards[i], reuse_port, min_per_shard, max_per_shard) < 0)
+        {
+            return -1;
+        }
+    }
+    LOG(LOG_INFO, " - ✔️ Server listening on port %d with %d listener%s...", PORT, num_shards,
+        num_shards == 1 ? "" : "s");
+
+    // every extra shard runs its own event loop thread, shard 0 runs on the main thread
+    for (int i = 1; i < num_shards; i++)
+    {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pin_attr(&attr, &shards[i].cpus);
+        pthread_create(&shards[i].thread, &attr, shard_function, &shards[i]);
+        pthread_attr_destroy(&attr);
+    }
+    pin_self(&shards[0].cpus);
 
+    // accept -> read full request -> enqueue -> flush response -> repeat all day long
+    event_loop_run(&shards[0].loop);
+
+    return 0;
+}
+
+/**
+ * @brief Opens a shard's welcome socket, starts its workers and sets up its event loop.
+ *
+ * @param shard The shard to start.
+ * @param reuse_port Non-zero to bind with SO_REUSEPORT alongside the other shards.
+ * @param min_threads Workers this shard keeps even when idle.
+ * @param max_threads Workers this shard may grow to under load.
+ * @return 0 on success, -1 on failure.
+ */
+int start_shard(Shard *shard, int reuse_port, int min_threads, int max_threads)
+{
     // setup the server port
-    int serverfd = welcome_socket(PORT);
+    int serverfd = welcome_socket(PORT, reuse_port);
     if (serverfd < 0)
     {
         return -1;
     }
-    printf(" - ✔️ Server listening on port %d...\n", PORT);
 
-    // accept -> enqueue -> repeat all day long
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
+    // among the SO_REUSEPORT listeners, the kernel then prefers this one for
+    // connections whose packets arrive on this shard's first core
+    if (reuse_port && shard->cpus.count > 0 && set_incoming_cpu(serverfd, shard->cpus.cpus[0]) < 0)
+    {
+        LOG(LOG_WARN, " - ⚠️ Warning: SO_INCOMING_CPU not supported, connections are not steered to shards");
+    }
+
+    // start the worker threads, pinned to this shard's cores
+    thread_pool(&shard->pool, min_threads, max_threads, server_options.queue_capacity, &shard->cpus);
 
-    while (1)
+    // the event loop owns accept and all socket reads/writes
+    if (event_loop_init(&shard->loop, serverfd, &shard->pool, server_options.use_io_uring) < 0)
     {
-        int client_socket;
-        // accept is a blocking function that will block until a client connects
-        client_socket = accept(serverfd, (struct sockaddr *)&client_addr, &client_len);
+        close(serverfd);
+        return -1;
+    }
+    return 0;
+}
 
-        if (client_socket < 0)
+/**
+ * @brief Thread entry point running one shard's event loop.
+ *
+ * @param arg Pointer to the Shard to run.
+ */
+void *shard_function(void *arg)
+{
+    Shard *shard = (Shard *)arg;
+    event_loop_run(&shard->loop);
+    return NULL;
+}
+
+/**
+ * @brief Reads the command line flags into server_options.
+ *        -u    use the io_uring I/O backend (falls back to epoll if the kernel lacks it)
+ *        -s N  shard into N SO_REUSEPORT listeners, each with its own loop and workers
+ *              (0 = one per online core)
+ *        -w N  minimum number of workers (DEFAULT_MIN_THREADS)
+ *        -W N  maximum number of workers the pools may grow to (DEFAULT_MAX_THREADS)
+ *        -q N  connections queued per worker before the event loop holds them back (DEFAULT_QUEUE_CAPACITY)
+ *        -a L  pin event loops and workers to the CPU list L ("0-7,16-23" or "all"), split
+ *              between shards; each worker gets one core
+ *        -l L  log level: error, warn, info (default, one line per request) or debug
+ *        -o F  append the log to file F instead of stdout
+ *        -F N  write the log out at least every N ms (DEFAULT_LOG_FLUSH_MS)
+ *        -A F  write a binary access log to F (read it with logdecode)
+ *        -S N  preallocate N MB per access log file, rotating when full (DEFAULT_ACCESS_LOG_MB)
+ *        -C N  keep up to N MB of small files in memory (DEFAULT_FILE_CACHE_MB, 0 = off)
+ *        -D N  keep up to N large files open with their metadata (DEFAULT_FD_CACHE_SIZE, 0 = off)
+ *        -r D  serve the files under directory D (DEFAULT_DOCROOT)
+ *        -P F  serve everything from pack F built by make pack, instead of a directory
+ *        -z N  gzip text files without a sidecar at zlib level N (DEFAULT_COMPRESS_LEVEL, 0 = off)
+ *        -h    print usage and exit
+ *
+ * @param argc Argument count from main().
+ * @param argv Argument vector from main().
+ */
+void parse_options(int argc, char *argv[])
+{
+    int opt;
+
+    server_options.min_threads = DEFAULT_MIN_THREADS;
+    server_options.max_threads = DEFAULT_MAX_THREADS;
+    server_options.queue_capacity = DEFAULT_QUEUE_CAPACITY;
+    server_options.log_path = NULL;
+    server_options.log_flush_ms = DEFAULT_LOG_FLUSH_MS;
+    server_options.access_log_path = NULL;
+    server_options.access_log_mb = DEFAULT_ACCESS_LOG_MB;
+    server_options.file_cache_mb = DEFAULT_FILE_CACHE_MB;
+    server_options.fd_cache_size = DEFAULT_FD_CACHE_SIZE;
+    server_options.docroot = DEFAULT_DOCROOT;
+    server_options.pack_path = NULL;
+    server_options.compress_level = DEFAULT_COMPRESS_LEVEL;
+
+    while ((opt = getopt(argc, argv, "us:w:W:q:a:l:o:F:A:S:C:D:r:P:z:h")) != -1)
+    {
+        switch (opt)
         {
-            printf(" - ❌ Error: accept() failed\n");
-            continue;
+        case 'u':
+            server_options.use_io_uring = 1;
+            break;
+        case 's':
+            server_options.shards = atoi(optarg);
+            if (server_options.shards <= 0)
+            {
+                server_options.shards = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            if (server_options.shards > MAX_POOLS)
+            {
+                server_options.shards = MAX_POOLS;
+            }
+            break;
+        case 'w':
+            server_options.min_threads = atoi(optarg);
+            break;
+        case 'W':
+            server_options.max_threads = atoi(optarg);
+            break;
+        case 'q':
+            server_options.queue_capacity = atoi(optarg);
+            break;
+        case 'a':
+            if (cpu_list_parse(optarg, &server_options.cpus) < 0)
+            {
+                fprintf(stderr, " - ❌ Error: bad CPU list \"%s\" (expected e.g. 0-3,8-11 or all)\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'l':
+            log_level = log_level_parse(optarg);
+            if (log_level < 0)
+            {
+                fprintf(stderr, " - ❌ Error: unknown log level \"%s\" (error, warn, info or debug)\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'o':
+            server_options.log_path = optarg;
+            break;
+        case 'F':
+            server_options.log_flush_ms = atoi(optarg);
+            break;
+        case 'A':
+            server_options.access_log_path = optarg;
+            break;
+        case 'S':
+            server_options.access_log_mb = atoi(optarg);
+            break;
+        case 'C':
+            server_options.file_cache_mb = atoi(optarg);
+            break;
+        case 'D':
+            server_options.fd_cache_size = atoi(optarg);
+            break;
+        case 'r':
+            server_options.docroot = optarg;
+            break;
+        case 'P':
+            server_options.pack_path = optarg;
+            break;
+        case 'z':
+            server_options.compress_level = atoi(optarg);
+            break;
+        case 'h':
+        default:
+            printf("Usage: %s [-u] [-s shards] [-w min_workers] [-W max_workers] [-q queue] [-a cpus]\n"
+                   "       [-l level] [-o logfile] [-F flush_ms] [-A access_log] [-S access_log_mb]\n"
+                   "       [-C cache_mb] [-D open_files] [-r docroot] [-P pack] [-z level]\n"
+                   "  -u    use the io_uring I/O backend instead of epoll\n"
+                   "  -s N  run N SO_REUSEPORT listeners with their own workers (0 = one per core)\n"
+                   "  -w N  keep at least N workers (default %d)\n"
+                   "  -W N  grow to at most N workers under load (default %d)\n"
+                   "  -q N  queue up to N connections per worker, then hold them back (default %d)\n"
+                   "  -a L  pin loops and workers to CPU list L, e.g. 0-7,16-23 or all\n"
+                   "  -l L  log level: error, warn, info or debug (default info)\n"
+                   "  -o F  append the log to file F instead of stdout\n"
+                   "  -F N  write buffered log records at least every N ms (default %d)\n"
+                   "  -A F  write a binary access log to F, decoded with ./logdecode\n"
+                   "  -S N  preallocate N MB per access log file, rotating to F.1..F.%d (default %d)\n"
+                   "  -C N  keep up to N MB of small files in memory, 0 = off (default %d)\n"
+                   "  -D N  keep up to N large files open between requests, 0 = off (default %d)\n"
+                   "  -r D  serve the files under directory D (default %s)\n"
+                   "  -P F  serve from pack F (built with make pack) instead of a directory\n"
+                   "  -z N  gzip text files without a sidecar at level 1-9, 0 = off (default %d)\n",
+                   argv[0], DEFAULT_MIN_THREADS, DEFAULT_MAX_THREADS, DEFAULT_QUEUE_CAPACITY,
+                   DEFAULT_LOG_FLUSH_MS, ACCESS_LOG_KEEP, DEFAULT_ACCESS_LOG_MB, DEFAULT_FILE_CACHE_MB,
+                   DEFAULT_FD_CACHE_SIZE, DEFAULT_DOCROOT, DEFAULT_COMPRESS_LEVEL);
+            exit(opt == 'h' ? 0 : 1);
         }
-        // send the ID to the queue
-        enqueue(client_socket);
     }
 
-    return 0;
+    if (server_options.min_threads < 1)
+        server_options.min_threads = 1;
+    if (server_options.max_threads < server_options.min_threads)
+        server_options.max_threads = server_options.min_threads;
+    if (server_options.queue_capacity < 1)
+        server_options.queue_capacity = 1;
+    if (server_options.access_log_mb < 1)
+        server_options.access_log_mb = 1;
+    if (server_options.file_cache_mb < 0)
+        server_options.file_cache_mb = 0;
+    if (server_options.fd_cache_size < 0)
+        server_options.fd_cache_size = 0;
 }
 
 /**
@@ -68,9 +341,10 @@ int main()
  *        connections on the specified port.
  *
  * @param port The port number on which the server will listen for incoming connections.
+ * @param reuse_port Non-zero to let several sockets bind the same port (SO_REUSEPORT).
  * @return the welcome socket file descriptor on success, or -1 on failure.
  */
-int welcome_socket(uint16_t port)
+int welcome_socket(uint16_t port, int reuse_port)
 {
     int serverfd;
     struct sockaddr_in server_addr;
@@ -80,7 +354,7 @@ int welcome_socket(uint16_t port)
     // SOCK_STREAM = specifies stream socket type who's default protocol is TCP
     if (create_socket(&serverfd, AF_INET, SOCK_STREAM) < 0)
         return -1;
-    if (set_socket_opt(serverfd) < 0)
+    if (set_socket_opt(serverfd, reuse_port) < 0)
     {
         close(serverfd);
         return -1;
@@ -135,9 +409,10 @@ int create_socket(int *socketfd, int domain, int type)
  * @brief Sets socket options for the given server socket file descriptor.
  *
  * @param serverfd The server socket file descriptor.
+ * @param reuse_port Non-zero to also set SO_REUSEPORT so each shard can bind its own listener.
  * @return 0 on success, -1 on failure.
  */
-int set_socket_opt(int serverfd)
+int set_socket_opt(int serverfd, int reuse_port)
 {
     // set address/port reusable (optional, for quick restarts)
     int opt = 1;
@@ -148,6 +423,13 @@ int set_socket_opt(int serverfd)
         perror(" - ❌ Error: setsockopt failed\n");
         return -1;
     }
+
+    // the kernel load-balances new connections across every socket bound this way
+    if (reuse_port && setsockopt(serverfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        perror(" - ❌ Error: setsockopt(SO_REUSEPORT) failed\n");
+        return -1;
+    }
     return 0;
 }
 
@@ -190,8 +472,9 @@ int bind_socket(int serverfd, uint16_t port, struct sockaddr_in *server_addr,
  */
 int start_listening(int serverfd)
 {
-    // listen for incoming connections
-    if (listen(serverfd, NUM_CONNECTIONS) < 0)
+    // a burst of clients queues in the kernel until the loop accepts it; the kernel caps this at
+    // net.core.somaxconn
+    if (listen(serverfd, SOMAXCONN) < 0)
     {
         perror(" - ❌ Error: welcome socket listening failed\n");
         close(serverfd);
@@ -7,11 +7,33 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "affinity.h"
+
 #include <netdb.h>
 #include <stdio.h>
 
 #define PATH_LEN 2048
 
-ssize_t recieve_message(int clientfd, char *buffer);
+// runtime settings picked on the command line
+typedef struct ServerOptions
+{
+    int use_io_uring;   // -u: serve sockets through io_uring instead of epoll
+    int shards;         // -s: number of SO_REUSEPORT listener shards (0 = single listener)
+    int min_threads;    // -w: workers the server keeps even when idle (split between shards)
+    int max_threads;    // -W: workers the server may grow to under load (split between shards)
+    int queue_capacity; // -q: connections each worker's queue holds before the loop backlogs them
+    CpuList cpus;       // -a: cores to pin loops and workers to, sliced between shards (empty = unpinned)
+    const char *log_path; // -o: file the log is appended to (NULL = stdout)
+    int log_flush_ms;     // -F: longest a log record waits before it is written
+    const char *access_log_path; // -A: binary access log file (NULL = none)
+    int access_log_mb;           // -S: megabytes preallocated per access log file before it rotates
+    int file_cache_mb;           // -C: megabytes of small files kept in memory (0 = none)
+    int fd_cache_size;           // -D: large files kept open between requests (0 = none)
+    const char *docroot;         // -r: directory the files are served from
+    const char *pack_path;       // -P: pack served instead of the directory (NULL = none)
+    int compress_level;          // -z: zlib level for text files without a gzip sidecar (0 = off)
+} ServerOptions;
+
+extern ServerOptions server_options;
 
 #endif
\ No newline at end of file
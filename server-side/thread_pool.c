@@ -1,5 +1,7 @@
 /**
- * Summary: Implementation of the thread pool, task queue, and worker threads for concurrent request handling.
+ * Summary: Implementation of the adaptive thread pool, per-worker task queues, and worker threads
+ *          for concurrent request handling. A supervisor thread grows each pool when connections
+ *          wait in its queues and shrinks it when workers sit idle.
  *
  * @file thread_pool.c
  * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
@@ -7,136 +9,478 @@
 #include "thread_pool.h"
 #include "http_parser.h"
 #include "server.h"
+#include "event_loop.h"
+#include "logger.h"
 
+#include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 // --- THREADING GLOBALS ---
-pthread_t thread_pool_ids[NUM_THREADS];
-pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;  // queue mutex lock
-pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;    // logging mutex lock
-pthread_cond_t queue_cond_var = PTHREAD_COND_INITIALIZER; // thread "Wake Up" signal
+pthread_mutex_t pools_mutex = PTHREAD_MUTEX_INITIALIZER;  // guards the pool registry
+pthread_once_t supervisor_once = PTHREAD_ONCE_INIT;       // one supervisor for every pool
 
-void thread_pool();
+// every pool that has been started, so stats can be summed across shards
+ThreadPool *pools[MAX_POOLS];
+int num_pools = 0;
+
+void thread_pool(ThreadPool *pool, int min_threads, int max_threads, int queue_capacity,
+                 const CpuList *cpus);
 void *worker_function(void *arg);
-void enqueue(int client_socket);
-int dequeue();
-void log_request(int client_fd, char *method, const char *filepath, int status);
+int enqueue(ThreadPool *pool, Connection *conn);
+Connection *dequeue(Worker *worker);
+void *supervisor_function(void *arg);
+int thread_pool_workers();
+int thread_pool_busy();
+int thread_pool_queued();
 
-// queue of client sockets, waiting for their requests to be serviced
-int socket_queue[MAX_SOCKETS]; // queue of client file descriptors
-int queue_head = 0;
-int queue_tail = 0;
-int queue_count = 0;
+// --- HELPER FUNCTIONS ---
+Connection *find_work(Worker *worker);
+int incoming_worker(ThreadPool *pool, Connection *conn, int active);
+int start_worker(ThreadPool *pool);
+void retire_worker(ThreadPool *pool);
+void supervise_pool(ThreadPool *pool);
+void start_supervisor();
+uint64_t monotonic_ns();
 
 
 // --- FUNCTIONS ---
 /**
- * @brief Initializes the thread pool by creating worker threads.
+ * @brief Initializes the thread pool by creating its minimum number of worker threads.
+ *
+ * @param pool The pool to initialize.
+ * @param min_threads Workers to start with and never shrink below.
+ * @param max_threads Workers the supervisor may grow to (capped at MAX_THREADS).
+ * @param queue_capacity Connections each worker's queue holds before the event loop holds them back.
+ * @param cpus Cores to pin the workers to, one each round-robin; NULL or empty to leave them unpinned.
  */
-void thread_pool()
+void thread_pool(ThreadPool *pool, int min_threads, int max_threads, int queue_capacity,
+                 const CpuList *cpus)
 {
-    for (int i = 0; i < NUM_THREADS; i++)
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+    if (min_threads < 1)
+        min_threads = 1;
+    if (min_threads > max_threads)
+        min_threads = max_threads;
+
+    pool->min_threads = min_threads;
+    pool->max_threads = max_threads;
+    pool->queue_capacity = queue_capacity < 1 ? 1 : queue_capacity;
+    pool->cpus.count = 0;
+    if (cpus != NULL)
+        pool->cpus = *cpus;
+    pool->active = 0;
+    pool->num_slots = 0;
+    pool->live = 0;
+    pool->next_worker = 0;
+    parking_init(&pool->idle);
+    pool->last_wait_ns = 0;
+    pool->last_dequeued = 0;
+    pool->busy_ticks = 0;
+    pool->idle_ticks = 0;
+    for (int i = 0; i < MAX_THREADS; i++)
     {
-        pthread_create(&thread_pool_ids[i], NULL, worker_function, NULL); 
+        pool->workers[i].state = WORKER_STOPPED;
     }
-    printf("Thread pool initialized with %d workers.\n", NUM_THREADS);
+
+    for (int i = 0; i < min_threads; i++)
+    {
+        if (start_worker(pool) < 0)
+            exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&pools_mutex);
+    if (num_pools < MAX_POOLS)
+        pools[num_pools++] = pool;
+    pthread_mutex_unlock(&pools_mutex);
+
+    pthread_once(&supervisor_once, start_supervisor);
+    LOG(LOG_INFO, "Thread pool initialized with %d workers (%d-%d, %d queued per worker).",
+        min_threads, min_threads, max_threads, pool->queue_capacity);
 }
 
 /**
  * @brief Function executed by each worker thread to handle incoming client requests.
+ *        Returns once the supervisor retires the worker and it has run out of work.
  *
- * @param arg Pointer to any arguments passed to the thread (not used here).
+ * @param arg Pointer to the Worker this thread runs as.
  */
 void *worker_function(void *arg)
 {
-    while (1)
+    Worker *worker = (Worker *)arg;
+    ThreadPool *pool = worker->pool;
+    Connection *conn;
+
+    // get a client from our queue (or someone else's) and sleep if there are none
+    while ((conn = dequeue(worker)) != NULL)
     {
-        // get a client from the queue and sleep if empty
-        int clientfd = dequeue();
+        conn->worker = worker->index; // its next request comes back to this core's cache
+        __atomic_store_n(&worker->wait_ns, worker->wait_ns + (monotonic_ns() - conn->enqueued_ns),
+                         __ATOMIC_RELAXED);
+        __atomic_store_n(&worker->dequeued, worker->dequeued + 1, __ATOMIC_RELAXED);
         //sleep(1); for testing
-        char buffer[BUFFER_SIZE] = {0};
 
-        // we use recieve_message which calls handle_request
-        receive_message(clientfd, buffer);
+        // the event loop already buffered the full request, so this never blocks on the socket.
+        // pipelined requests that arrived together are answered in order in one go
+        do
+        {
+            handle_request(conn);
+        } while (conn->keep_alive && request_ready(conn));
 
-        close(clientfd);
+        // give the socket back to the event loop to flush the response
+        event_loop_return(conn);
     }
+
+    // the slot may be reused by the supervisor from here on
+    __atomic_fetch_sub(&pool->live, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&worker->state, WORKER_STOPPED, __ATOMIC_RELEASE);
     return 0;
 }
 
 /**
- * @brief Enqueues a client socket into the socket queue for processing by worker threads.
+ * @brief Enqueues a connection with a complete request for processing by worker threads.
+ *        A connection goes back to the worker that served its previous request, whose
+ *        cache still holds its buffers and parser state. A new connection goes to the
+ *        worker pinned to the core that received its packets, if any, and is otherwise
+ *        spread round-robin. Never blocks: if every queue is full the connection is
+ *        left with the caller, which holds it back until workers free up.
  *
- * @param client_socket The client socket file descriptor to be enqueued.
+ * @param pool The pool whose workers should handle the connection.
+ * @param conn The connection to be enqueued.
+ * @return 0 if a worker queue took it, -1 if every queue is full.
  */
-void enqueue(int client_socket)
+int enqueue(ThreadPool *pool, Connection *conn)
 {
-    pthread_mutex_lock(&queue_mutex); // thou shalt not access!
+    int n = __atomic_load_n(&pool->active, __ATOMIC_ACQUIRE);
+    int target = conn->worker;
+    if (target < 0 && pool->cpus.count > 0)
+        target = incoming_worker(pool, conn, n);
+    if (target < 0 || target >= n)
+        target = __atomic_fetch_add(&pool->next_worker, 1, __ATOMIC_RELAXED) % n;
 
-    //----CRITICAL SECTION: START----------------------------------------------
-    if (queue_count < MAX_SOCKETS) // check if queue is full
+    // spill over to the other workers when the preferred queue is full
+    for (int i = 0; i < n; i++)
     {
-        socket_queue[queue_tail] = client_socket;    // put ticket in buffer
-        queue_tail = (queue_tail + 1) % MAX_SOCKETS; // move tail
-        queue_count++;
+        if (work_queue_push(&pool->workers[(target + i) % n].queue, conn) == 0)
+        {
+            parking_notify(&pool->idle);
+            return 0;
+        }
+    }
+    return -1;
+}
 
-        printf(" - [Producer] Enqueued client %d | Curr Queue Size: %d\n", client_socket, queue_count);
-        pthread_cond_signal(&queue_cond_var); // wake up sleeping beauty (thread)
+/**
+ * @brief Dequeues the next connection for a worker, stealing from the other
+ *        workers when its own queue is empty. Spins briefly, then sleeps until
+ *        a connection is enqueued anywhere in the pool.
+ *
+ * @param worker The worker asking for work.
+ * @return The dequeued connection, or NULL once the worker has been retired.
+ */
+Connection *dequeue(Worker *worker)
+{
+    Parking *idle = &worker->pool->idle;
+
+    while (__atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) == WORKER_RUNNING)
+    {
+        for (int spin = 0; spin <= idle->spin_limit; spin++)
+        {
+            Connection *conn = find_work(worker);
+            if (conn != NULL)
+                return conn;
+            cpu_relax();
+        }
+
+        // one last look after registering as a sleeper, so a push in between is not missed
+        uint32_t seen = parking_prepare(idle);
+        Connection *conn = find_work(worker);
+        if (conn != NULL)
+        {
+            parking_cancel(idle);
+            return conn;
+        }
+        if (__atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) != WORKER_RUNNING)
+        {
+            parking_cancel(idle);
+            break;
+        }
+        parking_wait(idle, seen);
     }
-    else
+    return NULL;
+}
+
+/**
+ * @brief Supervisor thread: every SUPERVISOR_INTERVAL_MS looks at each pool's
+ *        queue wait time, queue depth and idle workers and resizes it.
+ *
+ * @param arg Unused.
+ */
+void *supervisor_function(void *arg)
+{
+    (void)arg;
+    struct timespec interval = {0, SUPERVISOR_INTERVAL_MS * 1000000L};
+
+    while (1)
     {
-        printf(" - ⚠️ Warning: queue full! Dropping connection.\n");
-        close(client_socket);
+        nanosleep(&interval, NULL);
+
+        pthread_mutex_lock(&pools_mutex);
+        for (int i = 0; i < num_pools; i++)
+        {
+            supervise_pool(pools[i]);
+        }
+        pthread_mutex_unlock(&pools_mutex);
     }
-    //----CRITICAL SECTION: END------------------------------------------------
+    return NULL;
+}
+
+/**
+ * @brief Counts the live worker threads across every pool.
+ *
+ * @return Total number of worker threads.
+ */
+int thread_pool_workers()
+{
+    int total = 0;
 
-    pthread_mutex_unlock(&queue_mutex); // thou shall access
+    pthread_mutex_lock(&pools_mutex);
+    for (int i = 0; i < num_pools; i++)
+    {
+        total += __atomic_load_n(&pools[i]->live, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&pools_mutex);
+    return total;
 }
 
 /**
- * @brief Dequeues a client socket from the socket queue for processing by worker threads.
+ * @brief Counts the workers that are not parked waiting for work.
  *
- * @return The dequeued client socket file descriptor.
+ * @return Number of workers running (or looking for) a request right now.
  */
-int dequeue()
+int thread_pool_busy()
 {
-    pthread_mutex_lock(&queue_mutex); // thou shall not access
+    int total = 0;
 
-    //----CRITICAL SECTION: START----------------------------------------------
-    while (queue_count == 0) // wait while queue is empty
+    pthread_mutex_lock(&pools_mutex);
+    for (int i = 0; i < num_pools; i++)
     {
-        // sleep until signaled. releases lock when put to sleep.
-        pthread_cond_wait(&queue_cond_var, &queue_mutex);
+        int busy = __atomic_load_n(&pools[i]->live, __ATOMIC_RELAXED) -
+                   __atomic_load_n(&pools[i]->idle.sleepers, __ATOMIC_RELAXED);
+        total += busy > 0 ? busy : 0;
     }
+    pthread_mutex_unlock(&pools_mutex);
+    return total;
+}
 
-    // thread has woken up and has the lock! take the item from the queue
-    int client_socket = socket_queue[queue_head];
-    queue_head = (queue_head + 1) % MAX_SOCKETS;
-    queue_count--;
+/**
+ * @brief Counts the connections waiting in every pool's queues.
+ *
+ * @return Total number of queued connections.
+ */
+int thread_pool_queued()
+{
+    int total = 0;
 
-    printf("    - [Worker %lu] Dequeued client %d | Curr Queue Size: %d\n", pthread_self(), client_socket, queue_count);
-    //----CRITICAL SECTION: END------------------------------------------------
+    pthread_mutex_lock(&pools_mutex);
+    for (int i = 0; i < num_pools; i++)
+    {
+        int slots = __atomic_load_n(&pools[i]->num_slots, __ATOMIC_ACQUIRE);
+        for (int w = 0; w < slots; w++)
+        {
+            total += (int)work_queue_size(&pools[i]->workers[w].queue);
+        }
+    }
+    pthread_mutex_unlock(&pools_mutex);
+    return total;
+}
 
-    pthread_mutex_unlock(&queue_mutex); // thou shall access
-    return client_socket;
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Takes the oldest connection from the worker's own queue, or else
+ *        steals the oldest one from the next worker that has any. Retired
+ *        workers' queues are included, so nothing is stranded in them.
+ *
+ * @param worker The worker looking for work.
+ * @return A connection, or NULL if every queue in the pool is empty.
+ */
+Connection *find_work(Worker *worker)
+{
+    ThreadPool *pool = worker->pool;
+    int slots = __atomic_load_n(&pool->num_slots, __ATOMIC_ACQUIRE);
+    Connection *conn = (Connection *)work_queue_try_pop(&worker->queue);
+
+    for (int i = 1; conn == NULL && i < slots; i++)
+    {
+        Worker *victim = &pool->workers[(worker->index + i) % slots];
+        conn = (Connection *)work_queue_try_pop(&victim->queue);
+    }
+    return conn;
 }
 
 /**
- * @brief Thread-safe logging of HTTP requests to the server console.
+ * @brief Finds the active worker pinned to the core that handled the new
+ *        connection's receive interrupt (SO_INCOMING_CPU), so the request is
+ *        processed where its packets already are in cache.
  *
- * @param client_fd Socket file descriptor of the client being served
- * @param method HTTP method used in the request (e.g., "GET")
- * @param filepath Path of the requested resource
- * @param status HTTP status code returned to the client (e.g., 200, 404, etc.)
+ * @param pool The pool.
+ * @param conn A connection no worker has served yet.
+ * @param active Number of active workers.
+ * @return The worker's index, or -1 if none is pinned there.
  */
-void log_request(int client_fd, char *method, const char *filepath, int status)
+int incoming_worker(ThreadPool *pool, Connection *conn, int active)
 {
-    pthread_mutex_lock(&log_mutex);
+    int cpu = socket_incoming_cpu(conn->fd);
+    if (cpu < 0)
+        return -1;
 
-    //----CRITICAL SECTION: START----------------------------------------------
-    printf("[Worker thread: %lu] %s %s -> Status: %d\n", pthread_self(),
-           method, filepath, status);
-    //----CRITICAL SECTION: END------------------------------------------------
+    for (int i = 0; i < active; i++)
+    {
+        if (pool->workers[i].cpu == cpu)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Starts a worker in the first slot above the active ones. Its queue is
+ *        created the first time the slot is used and kept when it retires.
+ *        Only called by thread_pool() and the supervisor.
+ *
+ * @param pool The pool to grow.
+ * @return 0 on success, -1 on failure or if the slot's last thread has not exited yet.
+ */
+int start_worker(ThreadPool *pool)
+{
+    int index = pool->active;
+    Worker *worker = &pool->workers[index];
+
+    if (index >= pool->max_threads ||
+        __atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) != WORKER_STOPPED)
+        return -1;
+
+    if (index == pool->num_slots)
+    {
+        worker->index = index;
+        worker->pool = pool;
+        worker->wait_ns = 0;
+        worker->dequeued = 0;
+        if (work_queue_init(&worker->queue, pool->queue_capacity) < 0)
+            return -1;
+        __atomic_store_n(&pool->num_slots, index + 1, __ATOMIC_RELEASE);
+    }
+
+    worker->state = WORKER_RUNNING;
+    worker->cpu = pool->cpus.count > 0 ? pool->cpus.cpus[index % pool->cpus.count] : -1;
+    __atomic_fetch_add(&pool->live, 1, __ATOMIC_RELAXED);
+
+    // pinned before it first runs, so whatever it allocates is first touched on its own node
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pin_attr_cpu(&attr, worker->cpu) < 0)
+        LOG(LOG_WARN, " - ⚠️ Warning: could not pin worker %d to CPU %d", index, worker->cpu);
+    int err = pthread_create(&worker->thread_id, &attr, worker_function, worker);
+    pthread_attr_destroy(&attr);
+    if (err != 0)
+    {
+        LOG(LOG_WARN, " - ⚠️ Warning: could not start a worker thread");
+        worker->state = WORKER_STOPPED;
+        __atomic_fetch_sub(&pool->live, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
 
-    pthread_mutex_unlock(&log_mutex);
-}
\ No newline at end of file
+    // only now do new connections get routed to it
+    __atomic_store_n(&pool->active, index + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Retires the top active worker. It stops receiving new connections at
+ *        once, finishes what it is running and exits; whatever is left in its
+ *        queue is stolen by the others.
+ *
+ * @param pool The pool to shrink.
+ */
+void retire_worker(ThreadPool *pool)
+{
+    int index = pool->active - 1;
+
+    __atomic_store_n(&pool->active, index, __ATOMIC_RELEASE);
+    __atomic_store_n(&pool->workers[index].state, WORKER_RETIRING, __ATOMIC_SEQ_CST);
+    parking_wake_all(&pool->idle); // it may be parked; the others just look again
+}
+
+/**
+ * @brief One supervisor tick for one pool. A tick is overloaded when connections
+ *        waited GROW_WAIT_US on average or more are queued than there are workers,
+ *        and idle when at least two workers are parked and nothing is queued.
+ *        Growing needs GROW_TICKS such ticks in a row, shrinking SHRINK_TICKS.
+ *
+ * @param pool The pool to look at.
+ */
+void supervise_pool(ThreadPool *pool)
+{
+    uint64_t wait_ns = 0, dequeued = 0;
+    int queued = 0;
+
+    for (int i = 0; i < pool->num_slots; i++)
+    {
+        wait_ns += __atomic_load_n(&pool->workers[i].wait_ns, __ATOMIC_RELAXED);
+        dequeued += __atomic_load_n(&pool->workers[i].dequeued, __ATOMIC_RELAXED);
+        queued += (int)work_queue_size(&pool->workers[i].queue);
+    }
+
+    uint64_t tick_dequeued = dequeued - pool->last_dequeued;
+    uint64_t avg_wait_us = tick_dequeued ? (wait_ns - pool->last_wait_ns) / tick_dequeued / 1000 : 0;
+    pool->last_wait_ns = wait_ns;
+    pool->last_dequeued = dequeued;
+
+    int parked = __atomic_load_n(&pool->idle.sleepers, __ATOMIC_RELAXED);
+    int overloaded = avg_wait_us >= GROW_WAIT_US || queued > pool->active;
+    int idle = parked >= 2 && queued == 0;
+
+    pool->busy_ticks = overloaded ? pool->busy_ticks + 1 : 0;
+    pool->idle_ticks = idle ? pool->idle_ticks + 1 : 0;
+
+    if (pool->busy_ticks >= GROW_TICKS && pool->active < pool->max_threads)
+    {
+        if (start_worker(pool) == 0)
+            LOG(LOG_INFO, " - ✔️ Pool grew to %d workers (queued %d, avg wait %lu us)",
+                   pool->active, queued, (unsigned long)avg_wait_us);
+        pool->busy_ticks = 0;
+    }
+    else if (pool->idle_ticks >= SHRINK_TICKS && pool->active > pool->min_threads)
+    {
+        retire_worker(pool);
+        LOG(LOG_INFO, " - ✔️ Pool shrank to %d workers", pool->active);
+        pool->idle_ticks = 0;
+    }
+}
+
+/**
+ * @brief Starts the supervisor thread (through pthread_once, with the first pool).
+ */
+void start_supervisor()
+{
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, supervisor_function, NULL) != 0)
+    {
+        LOG(LOG_WARN, " - ⚠️ Warning: could not start the pool supervisor, pools stay at their minimum");
+        return;
+    }
+    pthread_detach(thread);
+}
+
+/**
+ * @brief Current monotonic time in nanoseconds.
+ *
+ * @return Nanoseconds since an arbitrary starting point.
+ */
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
@@ -1,5 +1,5 @@
 /**
- * Summary: Header file defining thread pool interfaces, queue management, and logging prototypes.
+ * Summary: Header file defining the adaptive thread pool, per-worker queue management, and logging prototypes.
  *
  * @file thread_pool.h
  * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
@@ -7,16 +7,77 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include "affinity.h"
+#include "connection.h"
+#include "work_queue.h"
+
 #include <pthread.h>
 #include <semaphore.h>
 #include <sys/stat.h>
 
-#define NUM_THREADS 4 
-#define MAX_SOCKETS 10
-#define BUFFER_SIZE 1024
+#define MAX_THREADS 64            // hard cap on workers per pool (-W)
+#define DEFAULT_MIN_THREADS 4     // workers a pool never shrinks below (-w)
+#define DEFAULT_MAX_THREADS 16    // workers a pool never grows beyond (-W)
+#define DEFAULT_QUEUE_CAPACITY 4  // queued connections per worker before the event loop holds them back (-q)
+#define MAX_POOLS 256 // one pool per listener shard
+
+// supervisor tuning: grow fast when overloaded, shrink slowly when idle (hysteresis)
+#define SUPERVISOR_INTERVAL_MS 100
+#define GROW_WAIT_US 1000 // average queue wait over a tick that counts as overloaded
+#define GROW_TICKS 3      // overloaded ticks in a row before a worker is added
+#define SHRINK_TICKS 50   // idle ticks in a row (5 s) before a worker is retired
+
+struct ThreadPool;
+
+typedef enum WorkerState
+{
+    WORKER_STOPPED = 0, // no thread in this slot
+    WORKER_RUNNING,
+    WORKER_RETIRING     // told to exit once it runs out of work
+} WorkerState;
+
+// one worker thread and the connections assigned to it
+typedef struct Worker
+{
+    pthread_t thread_id;
+    int index;
+    struct ThreadPool *pool;
+    WorkerState state;
+    int cpu;         // core it is pinned to, -1 if not pinned
+    WorkQueue queue; // lock-free, so idle workers can steal from it
+
+    // load this worker saw, written only by the worker, read by the supervisor
+    uint64_t wait_ns;  // total time its connections sat in a queue
+    uint64_t dequeued; // connections it took
+} Worker;
+
+// a set of workers, each with its own queue of connections with a full request buffered.
+// the supervisor resizes it between min_threads and max_threads, always at the top slot
+typedef struct ThreadPool
+{
+    Worker workers[MAX_THREADS];
+    int min_threads;
+    int max_threads;
+    int queue_capacity;
+    CpuList cpus;         // cores the workers are pinned to, one each round-robin (empty = unpinned)
+    int active;           // workers [0, active) are running and take new connections
+    int num_slots;        // workers [0, num_slots) have a queue idle workers may steal from
+    int live;             // threads that have not exited yet, including retiring ones
+    unsigned next_worker; // round-robin target for connections no worker has served yet
+    Parking idle;         // where workers with nothing to run or steal sleep
+
+    // supervisor bookkeeping
+    uint64_t last_wait_ns;
+    uint64_t last_dequeued;
+    int busy_ticks;
+    int idle_ticks;
+} ThreadPool;
 
-void thread_pool();
-void enqueue(int client_socket);
-void log_request(int client_fd, char *method, const char *filepath, int status);
-extern int queue_count;
-#endif
\ No newline at end of file
+void thread_pool(ThreadPool *pool, int min_threads, int max_threads, int queue_capacity,
+                 const CpuList *cpus);
+int enqueue(ThreadPool *pool, Connection *conn);
+int thread_pool_workers();
+int thread_pool_busy();
+int thread_pool_queued();
+uint64_t monotonic_ns();
+#endif
@@ -0,0 +1,204 @@
+/**
+ * Summary: Vectorized delimiter scanning for the request parser. The parser hands long tokens
+ *          (the path, header names and header values) to scan_token(), which looks at 16 or 32
+ *          bytes per step for the next byte the state machine has to act on. The widest
+ *          implementation the CPU supports is picked at startup, with a scalar fallback.
+ *
+ * @file token_scan.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#include "token_scan.h"
+
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SCAN 1
+#endif
+
+TokenScanner scan_token = scan_token_scalar;
+const char *scan_token_name = "scalar";
+
+// --- FUNCTION DECLERATIONS ---
+void token_scan_init();
+size_t scan_token_scalar(const char *buffer, size_t len, char stop);
+#ifdef HAVE_X86_SCAN
+size_t scan_token_sse2(const char *buffer, size_t len, char stop);
+size_t scan_token_sse42(const char *buffer, size_t len, char stop);
+size_t scan_token_avx2(const char *buffer, size_t len, char stop);
+#endif
+
+// --- FUNCTIONS ---
+/**
+ * @brief Picks the fastest scanner the CPU supports. Called once from main()
+ *        before any worker or event loop thread starts.
+ */
+void token_scan_init()
+{
+#ifdef HAVE_X86_SCAN
+    __builtin_cpu_init();
+
+    // SSE2 compare + movemask beats PCMPESTRI (longer latency per 16 bytes) on our
+    // header mix, so the SSE4.2 scanner is only kept for `make bench` to compare against
+    if (__builtin_cpu_supports("avx2"))
+    {
+        scan_token = scan_token_avx2;
+        scan_token_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        scan_token = scan_token_sse2;
+        scan_token_name = "sse2";
+    }
+#endif
+    printf(" - ✔️ Using %s request scanner\n", scan_token_name);
+}
+
+/**
+ * @brief Byte-at-a-time scanner, used when no vector unit is available
+ *        and for the tail shorter than one vector.
+ *
+ * @param buffer Bytes to scan.
+ * @param len Number of bytes to scan.
+ * @param stop Extra delimiter to stop at besides control bytes.
+ * @return Offset of the first control or stop byte, or len if there is none.
+ */
+size_t scan_token_scalar(const char *buffer, size_t len, char stop)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char ch = (unsigned char)buffer[i];
+        if (ch < 0x20 || ch == 0x7f || ch == (unsigned char)stop)
+        {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef HAVE_X86_SCAN
+/**
+ * @brief SSE2 scanner: 16 bytes per step with compare + movemask.
+ *        Control bytes are found with an unsigned max against 0x1f, which
+ *        leaves bytes >= 0x80 (UTF-8 in paths and values) alone.
+ *
+ * @param buffer Bytes to scan.
+ * @param len Number of bytes to scan.
+ * @param stop Extra delimiter to stop at besides control bytes.
+ * @return Offset of the first control or stop byte, or len if there is none.
+ */
+__attribute__((target("sse2")))
+size_t scan_token_sse2(const char *buffer, size_t len, char stop)
+{
+    const __m128i ctl_max = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i stop_v = _mm_set1_epi8(stop);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buffer + i));
+        __m128i is_ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, ctl_max), ctl_max);
+        __m128i hit = _mm_or_si128(is_ctl, _mm_or_si128(_mm_cmpeq_epi8(v, del),
+                                                        _mm_cmpeq_epi8(v, stop_v)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_token_scalar(buffer + i, len - i, stop);
+}
+
+/**
+ * @brief SSE4.2 scanner: 16 bytes per step with PCMPESTRI in range mode,
+ *        matching [0x00-0x1f], [0x7f] and [stop] in one instruction.
+ *
+ * @param buffer Bytes to scan.
+ * @param len Number of bytes to scan.
+ * @param stop Extra delimiter to stop at besides control bytes.
+ * @return Offset of the first control or stop byte, or len if there is none.
+ */
+__attribute__((target("sse4.2")))
+size_t scan_token_sse42(const char *buffer, size_t len, char stop)
+{
+    const __m128i ranges = _mm_setr_epi8(0x00, 0x1f, 0x7f, 0x7f, stop, stop,
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buffer + i));
+        int index = _mm_cmpestri(ranges, 6, v, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16)
+        {
+            return i + index;
+        }
+    }
+    return i + scan_token_scalar(buffer + i, len - i, stop);
+}
+
+/**
+ * @brief AVX2 scanner: the SSE2 compare + movemask on 32 bytes per step.
+ *        The 16 byte head check is written inline rather than calling
+ *        scan_token_sse2(), so every instruction here is VEX encoded and
+ *        there is no SSE/AVX transition penalty between the two.
+ *
+ * @param buffer Bytes to scan.
+ * @param len Number of bytes to scan.
+ * @param stop Extra delimiter to stop at besides control bytes.
+ * @return Offset of the first control or stop byte, or len if there is none.
+ */
+__attribute__((target("avx2")))
+size_t scan_token_avx2(const char *buffer, size_t len, char stop)
+{
+    const __m256i ctl_max = _mm256_set1_epi8(0x1f);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i stop_v = _mm256_set1_epi8(stop);
+    size_t i = 0;
+
+    // most header tokens are short, so look at the first 16 bytes before going wide
+    if (len >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)buffer);
+        __m128i is_ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm256_castsi256_si128(ctl_max)),
+                                        _mm256_castsi256_si128(ctl_max));
+        __m128i hit = _mm_or_si128(is_ctl,
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(del)),
+                                                _mm_cmpeq_epi8(v, _mm256_castsi256_si128(stop_v))));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return __builtin_ctz(mask);
+        }
+        i = 16;
+    }
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buffer + i));
+        __m256i is_ctl = _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl_max), ctl_max);
+        __m256i hit = _mm256_or_si256(is_ctl, _mm256_or_si256(_mm256_cmpeq_epi8(v, del),
+                                                              _mm256_cmpeq_epi8(v, stop_v)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    // finish with one overlapping 32 byte load instead of a scalar tail
+    if (len >= 32 && i < len)
+    {
+        size_t last = len - 32;
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buffer + last));
+        __m256i is_ctl = _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl_max), ctl_max);
+        __m256i hit = _mm256_or_si256(is_ctl, _mm256_or_si256(_mm256_cmpeq_epi8(v, del),
+                                                              _mm256_cmpeq_epi8(v, stop_v)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit) >> (i - last);
+        return mask != 0 ? i + __builtin_ctz(mask) : len;
+    }
+    return i + scan_token_scalar(buffer + i, len - i, stop);
+}
+#endif
@@ -0,0 +1,28 @@
+/**
+ * Summary: Header file for the vectorized delimiter scanner used by the request parser.
+ *
+ * @file token_scan.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef TOKEN_SCAN_H
+#define TOKEN_SCAN_H
+
+#include <stddef.h>
+
+// finds the first byte in buffer[0..len) that is a control byte (< 0x20 or 0x7f) or equal to stop
+typedef size_t (*TokenScanner)(const char *buffer, size_t len, char stop);
+
+// picked by token_scan_init() from what the CPU supports, scalar until then
+extern TokenScanner scan_token;
+extern const char *scan_token_name;
+
+void token_scan_init();
+size_t scan_token_scalar(const char *buffer, size_t len, char stop);
+
+#if defined(__x86_64__) || defined(__i386__)
+size_t scan_token_sse2(const char *buffer, size_t len, char stop);
+size_t scan_token_sse42(const char *buffer, size_t len, char stop);
+size_t scan_token_avx2(const char *buffer, size_t len, char stop);
+#endif
+
+#endif
@@ -0,0 +1,728 @@
+/**
+ * Summary: io_uring backend for the event loop. Accepts with a multishot accept, reads requests
+ *          into a ring of provided buffers and sends responses as linked send/splice chains, so
+ *          each loop iteration batches all socket and file I/O into a single io_uring_enter().
+ *
+ * @file uring_loop.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE // SPLICE_F_MOVE
+
+#include "uring_loop.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// low bits of a CQE's user_data say which operation completed; the rest is the Connection
+#define OP_RECV 1
+#define OP_SEND 2       // gathered memory segments (sendmsg)
+#define OP_SPLICE_IN 3  // file -> pipe
+#define OP_SPLICE_OUT 4 // pipe -> socket
+#define OP_ACCEPT 5
+#define OP_WAKE 6
+#define OP_TIMEOUT 7
+#define OP_MASK 7
+
+typedef struct UringLoop
+{
+    int ring_fd;
+
+    // our mappings of the kernel's rings (cq_ring is NULL when it shares sq_ring), kept for teardown
+    void *sq_ring;
+    size_t sq_ring_len;
+    void *cq_ring;
+    size_t cq_ring_len;
+    size_t sqes_len;
+
+    // submission queue ring (shared with the kernel)
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned to_submit; // SQEs queued since the last io_uring_enter()
+
+    // completion queue ring (shared with the kernel)
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // provided buffer ring the kernel picks receive buffers from
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_len;
+    char *buf_pool;
+
+    // interval of the idle sweep timer (must outlive the timeout request)
+    struct __kernel_timespec sweep_interval;
+} UringLoop;
+
+// --- FUNCTION DECLERATIONS ---
+int uring_loop_init(EventLoop *loop);
+void uring_loop_run(EventLoop *loop);
+void uring_submit_recv(EventLoop *loop, Connection *conn);
+void uring_submit_write(EventLoop *loop, Connection *conn);
+int uring_map_rings(UringLoop *ring, struct io_uring_params *params);
+int uring_supports_ops(UringLoop *ring);
+int uring_setup_buffers(UringLoop *ring);
+void uring_teardown(UringLoop *ring);
+void uring_recycle_buffer(UringLoop *ring, unsigned short bid);
+struct io_uring_sqe *uring_get_sqe(UringLoop *ring);
+int uring_enter(UringLoop *ring, unsigned wait_nr);
+void uring_submit_accept(EventLoop *loop);
+void uring_submit_wake(EventLoop *loop);
+void uring_submit_timeout(EventLoop *loop);
+void uring_handle_cqe(EventLoop *loop, struct io_uring_cqe *cqe);
+void uring_handle_recv(EventLoop *loop, Connection *conn, struct io_uring_cqe *cqe);
+void uring_handle_write(EventLoop *loop, Connection *conn, int op, int res);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Creates the io_uring instance, checks the kernel supports every operation we
+ *        need and registers the provided receive buffers. Any failure leaves the loop
+ *        untouched so the caller can fall back to epoll.
+ *
+ * @param loop The event loop to attach the ring to.
+ * @return 0 on success, -1 if io_uring is unavailable or too old.
+ */
+int uring_loop_init(EventLoop *loop)
+{
+    UringLoop *ring = (UringLoop *)calloc(1, sizeof(UringLoop));
+    if (ring == NULL)
+    {
+        perror("failed to allocate UringLoop on the heap");
+        return -1;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->ring_fd < 0)
+    {
+        free(ring);
+        return -1;
+    }
+
+    if (uring_map_rings(ring, &params) < 0 || uring_supports_ops(ring) < 0 ||
+        uring_setup_buffers(ring) < 0)
+    {
+        uring_teardown(ring); // the rings stay alive while any mapping of them does
+        return -1;
+    }
+
+    loop->uring = ring;
+    uring_submit_accept(loop);
+    uring_submit_wake(loop);
+    uring_submit_timeout(loop);
+    return 0;
+}
+
+/**
+ * @brief Runs the io_uring loop forever: submit everything queued, wait for at least
+ *        one completion, then handle every completion that is ready.
+ *
+ * @param loop The event loop running on io_uring.
+ */
+void uring_loop_run(EventLoop *loop)
+{
+    UringLoop *ring = loop->uring;
+
+    while (1)
+    {
+        if (uring_enter(ring, 1) < 0)
+        {
+            perror(" - ❌ Error: io_uring_enter failed");
+            return;
+        }
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail)
+        {
+            uring_handle_cqe(loop, &ring->cqes[head & ring->cq_mask]);
+            head++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief Queues a receive on the connection. The kernel picks a buffer from the
+ *        provided buffer ring, so nothing is pinned while the client is idle.
+ *
+ * @param loop The event loop running on io_uring.
+ * @param conn The connection to read from.
+ */
+void uring_submit_recv(EventLoop *loop, Connection *conn)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(loop->uring);
+    size_t space = CONN_BUFFER_SIZE - 1 - conn->in_len;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->len = space < RECV_BUF_SIZE ? space : RECV_BUF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUF_GROUP;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | OP_RECV;
+    conn->inflight++;
+}
+
+/**
+ * @brief Queues the next round of the pending responses as one linked chain:
+ *        one sendmsg of every leading memory segment, then splice a chunk of the
+ *        following file into the connection's pipe and the pipe into the socket.
+ *        Once the queue is empty the response is done.
+ *
+ * @param loop The event loop running on io_uring.
+ * @param conn The connection with a response to send.
+ */
+void uring_submit_write(EventLoop *loop, Connection *conn)
+{
+    UringLoop *ring = loop->uring;
+    struct io_uring_sqe *prev = NULL;
+    uint64_t tag = (uint64_t)(uintptr_t)conn;
+
+    if (conn->failed)
+    {
+        conn_destroy(conn);
+        return;
+    }
+
+    // a chain must not be split across two submissions
+    while (ring->sq_entries - (*ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)) < 3)
+    {
+        uring_enter(ring, 0);
+    }
+
+    // drop file segments that have nothing left to send (e.g. empty files)
+    while (conn->out_head != NULL && conn->out_head->data == NULL &&
+           conn->out_head->file_off >= conn->out_head->file_end && conn->pipe_bytes == 0)
+    {
+        conn_pop_segment(conn);
+    }
+
+    OutSegment *seg = conn->out_head;
+    int count = conn_gather(conn, conn->out_iov, OUT_IOV_MAX);
+    if (count > 0)
+    {
+        memset(&conn->out_msg, 0, sizeof(conn->out_msg));
+        conn->out_msg.msg_iov = conn->out_iov;
+        conn->out_msg.msg_iovlen = count;
+
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&conn->out_msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL | (conn_body_follows(conn, count) ? MSG_MORE : 0);
+        sqe->user_data = tag | OP_SEND;
+        conn->inflight++;
+        prev = sqe;
+
+        for (int i = 0; i < count; i++)
+        {
+            seg = seg->next; // first segment after the gathered bytes
+        }
+    }
+
+    // the file segment right after the gathered bytes (or at the head) gets the next chunk
+    size_t chunk = 0;
+    off_t file_left = 0; // file bytes still to be spliced in after this chain
+    if (seg != NULL && seg->data == NULL)
+    {
+        chunk = conn->pipe_bytes;
+        file_left = seg->file_end - seg->file_off;
+    }
+    if (seg != NULL && seg->data == NULL && chunk == 0 && seg->file_off < seg->file_end)
+    {
+        int pipe_size = conn_open_pipe(conn);
+        if (pipe_size < 0)
+        {
+            conn->failed = 1;
+            if (conn->inflight == 0)
+                conn_destroy(conn);
+            return;
+        }
+
+        chunk = pipe_size;
+        if ((off_t)chunk > seg->file_end - seg->file_off)
+        {
+            chunk = seg->file_end - seg->file_off;
+        }
+        file_left -= chunk;
+
+        if (prev != NULL)
+            prev->flags |= IOSQE_IO_LINK;
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->splice_fd_in = seg->file_fd;
+        sqe->splice_off_in = seg->file_off;
+        sqe->fd = conn->pipe_fds[1];
+        sqe->off = (uint64_t)-1;
+        sqe->len = chunk;
+        sqe->splice_flags = SPLICE_F_MOVE;
+        sqe->user_data = tag | OP_SPLICE_IN;
+        conn->inflight++;
+        prev = sqe;
+    }
+
+    if (chunk > 0)
+    {
+        if (prev != NULL)
+            prev->flags |= IOSQE_IO_LINK;
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->splice_fd_in = conn->pipe_fds[0];
+        sqe->splice_off_in = (uint64_t)-1;
+        sqe->fd = conn->fd;
+        sqe->off = (uint64_t)-1;
+        sqe->len = chunk;
+        sqe->splice_flags = SPLICE_F_MOVE | (file_left > 0 ? SPLICE_F_MORE : 0);
+        sqe->user_data = tag | OP_SPLICE_OUT;
+        conn->inflight++;
+    }
+
+    if (conn->inflight == 0 && conn->out_head == NULL)
+    {
+        connection_done(loop, conn); // every response is out
+    }
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Maps the submission queue, completion queue and SQE array into our address space.
+ *        Each mapping is recorded as soon as it succeeds, so uring_teardown() undoes
+ *        exactly what was mapped when a later one fails.
+ *
+ * @param ring The ring being set up.
+ * @param params Parameters filled in by io_uring_setup().
+ * @return 0 on success, -1 on failure.
+ */
+int uring_map_rings(UringLoop *ring, struct io_uring_params *params)
+{
+    size_t sq_len = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    size_t cq_len = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+
+    // newer kernels share one mapping for both rings
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (cq_len > sq_len)
+            sq_len = cq_len;
+        cq_len = sq_len;
+    }
+
+    char *sq_ptr = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+        return -1;
+    ring->sq_ring = sq_ptr;
+    ring->sq_ring_len = sq_len;
+
+    char *cq_ptr = sq_ptr;
+    if (!(params->features & IORING_FEAT_SINGLE_MMAP))
+    {
+        cq_ptr = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED)
+            return -1;
+        ring->cq_ring = cq_ptr;
+        ring->cq_ring_len = cq_len;
+    }
+
+    size_t sqes_len = params->sq_entries * sizeof(struct io_uring_sqe);
+    struct io_uring_sqe *sqes = mmap(NULL, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     ring->ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return -1;
+    ring->sqes = sqes;
+    ring->sqes_len = sqes_len;
+
+    ring->sq_head = (unsigned *)(sq_ptr + params->sq_off.head);
+    ring->sq_tail = (unsigned *)(sq_ptr + params->sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq_ptr + params->sq_off.ring_mask);
+    ring->sq_entries = params->sq_entries;
+    ring->sq_array = (unsigned *)(sq_ptr + params->sq_off.array);
+
+    ring->cq_head = (unsigned *)(cq_ptr + params->cq_off.head);
+    ring->cq_tail = (unsigned *)(cq_ptr + params->cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq_ptr + params->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq_ptr + params->cq_off.cqes);
+    return 0;
+}
+
+/**
+ * @brief Asks the kernel which operations it supports and makes sure all of ours are there.
+ *
+ * @param ring The ring to probe.
+ * @return 0 if every operation is supported, -1 otherwise.
+ */
+int uring_supports_ops(UringLoop *ring)
+{
+    const int needed[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG,
+                          IORING_OP_SPLICE, IORING_OP_POLL_ADD};
+    size_t probe_len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probe_len);
+    if (probe == NULL)
+        return -1;
+
+    int status = 0;
+    if (syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+    {
+        status = -1;
+    }
+
+    for (size_t i = 0; status == 0 && i < sizeof(needed) / sizeof(needed[0]); i++)
+    {
+        if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED))
+        {
+            status = -1;
+        }
+    }
+
+    free(probe);
+    return status;
+}
+
+/**
+ * @brief Allocates the receive buffers and registers them as a provided buffer ring.
+ *        Registering the ring also requires a kernel new enough for multishot accept.
+ *
+ * @param ring The ring to register the buffers with.
+ * @return 0 on success, -1 on failure.
+ */
+int uring_setup_buffers(UringLoop *ring)
+{
+    size_t ring_len = RECV_BUF_COUNT * sizeof(struct io_uring_buf);
+
+    ring->buf_ring = mmap(NULL, ring_len, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED)
+    {
+        ring->buf_ring = NULL;
+        return -1;
+    }
+    ring->buf_ring_len = ring_len;
+
+    ring->buf_pool = (char *)malloc((size_t)RECV_BUF_COUNT * RECV_BUF_SIZE);
+    if (ring->buf_pool == NULL)
+        return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = RECV_BUF_COUNT;
+    reg.bgid = RECV_BUF_GROUP;
+
+    if (syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return -1;
+
+    for (unsigned short bid = 0; bid < RECV_BUF_COUNT; bid++)
+    {
+        uring_recycle_buffer(ring, bid);
+    }
+    return 0;
+}
+
+/**
+ * @brief Undoes a partly or fully set up ring: unmaps the kernel's rings and the SQE
+ *        array (closing the fd alone leaves the instance alive while they are mapped),
+ *        closes the fd, which drops the buffer registration, then frees the buffers.
+ *
+ * @param ring The ring; it is freed.
+ */
+void uring_teardown(UringLoop *ring)
+{
+    if (ring->sqes != NULL)
+        munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ring != NULL)
+        munmap(ring->cq_ring, ring->cq_ring_len);
+    if (ring->sq_ring != NULL)
+        munmap(ring->sq_ring, ring->sq_ring_len);
+    close(ring->ring_fd);
+
+    if (ring->buf_ring != NULL)
+        munmap(ring->buf_ring, ring->buf_ring_len);
+    free(ring->buf_pool);
+    free(ring);
+}
+
+/**
+ * @brief Hands a receive buffer back to the kernel through the provided buffer ring.
+ *
+ * @param ring The ring owning the buffer.
+ * @param bid Id of the buffer being returned.
+ */
+void uring_recycle_buffer(UringLoop *ring, unsigned short bid)
+{
+    unsigned short tail = ring->buf_ring->tail;
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[tail & (RECV_BUF_COUNT - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(ring->buf_pool + (size_t)bid * RECV_BUF_SIZE);
+    buf->len = RECV_BUF_SIZE;
+    buf->bid = bid;
+
+    // publish the entry before the kernel can see the new tail
+    __atomic_store_n(&ring->buf_ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Returns a zeroed submission entry, submitting what is queued first if the
+ *        submission queue is full. The entry is published right away; the kernel only
+ *        looks at it on the next io_uring_enter().
+ *
+ * @param ring The ring to take the entry from.
+ * @return Pointer to the submission entry.
+ */
+struct io_uring_sqe *uring_get_sqe(UringLoop *ring)
+{
+    unsigned tail = *ring->sq_tail;
+
+    while (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+    {
+        uring_enter(ring, 0); // queue full, let the kernel consume some entries
+    }
+
+    unsigned index = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return sqe;
+}
+
+/**
+ * @brief Submits every queued entry and optionally waits for completions.
+ *
+ * @param ring The ring to submit on.
+ * @param wait_nr Number of completions to wait for (0 to only submit).
+ * @return 0 on success, -1 on failure.
+ */
+int uring_enter(UringLoop *ring, unsigned wait_nr)
+{
+    while (1)
+    {
+        unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+        int consumed = syscall(__NR_io_uring_enter, ring->ring_fd, ring->to_submit,
+                               wait_nr, flags, NULL, 0);
+        if (consumed < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EBUSY)
+                return 0; // completion queue backed up, go reap it first
+            return -1;
+        }
+
+        ring->to_submit -= consumed;
+        return 0;
+    }
+}
+
+/**
+ * @brief Arms a multishot accept on the welcome socket; every new client
+ *        produces a completion without resubmitting.
+ *
+ * @param loop The event loop running on io_uring.
+ */
+void uring_submit_accept(EventLoop *loop)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(loop->uring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = OP_ACCEPT;
+}
+
+/**
+ * @brief Arms a multishot poll on the wakeup eventfd the workers write to.
+ *
+ * @param loop The event loop running on io_uring.
+ */
+void uring_submit_wake(EventLoop *loop)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(loop->uring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = loop->wakefd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = OP_WAKE;
+}
+
+/**
+ * @brief Arms a timeout so the loop wakes up to close idle keep-alive connections
+ *        even when no I/O completes.
+ *
+ * @param loop The event loop running on io_uring.
+ */
+void uring_submit_timeout(EventLoop *loop)
+{
+    UringLoop *ring = loop->uring;
+    ring->sweep_interval.tv_sec = SWEEP_INTERVAL_MS / 1000;
+    ring->sweep_interval.tv_nsec = (SWEEP_INTERVAL_MS % 1000) * 1000000L;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&ring->sweep_interval;
+    sqe->len = 1;
+    sqe->user_data = OP_TIMEOUT;
+}
+
+/**
+ * @brief Dispatches one completion to the matching handler.
+ *
+ * @param loop The event loop running on io_uring.
+ * @param cqe The completion entry.
+ */
+void uring_handle_cqe(EventLoop *loop, struct io_uring_cqe *cqe)
+{
+    int op = cqe->user_data & OP_MASK;
+    Connection *conn = (Connection *)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK);
+
+    if (op == OP_ACCEPT)
+    {
+        if (cqe->res >= 0)
+        {
+            Connection *client = conn_create(cqe->res, loop);
+            if (client == NULL)
+                close(cqe->res);
+            else
+                wait_readable(loop, client);
+        }
+        else if (cqe->res != -EAGAIN && cqe->res != -ECONNABORTED)
+        {
+            LOG(LOG_ERROR, " - ❌ Error: accept() failed");
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+            uring_submit_accept(loop); // multishot was terminated, re-arm it
+    }
+    else if (op == OP_WAKE)
+    {
+        drain_returned(loop);
+
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+            uring_submit_wake(loop);
+    }
+    else if (op == OP_TIMEOUT)
+    {
+        sweep_idle(loop);
+        uring_submit_timeout(loop);
+    }
+    else if (op == OP_RECV)
+    {
+        conn->inflight--;
+        uring_handle_recv(loop, conn, cqe);
+    }
+    else
+    {
+        conn->inflight--;
+        uring_handle_write(loop, conn, op, cqe->res);
+    }
+}
+
+/**
+ * @brief Copies a completed receive out of its provided buffer into the connection
+ *        and hands the buffer straight back to the kernel.
+ *
+ * @param loop The event loop running on io_uring.
+ * @param conn The connection that received data.
+ * @param cqe The receive completion.
+ */
+void uring_handle_recv(EventLoop *loop, Connection *conn, struct io_uring_cqe *cqe)
+{
+    if (cqe->res == -ENOBUFS)
+    {
+        uring_submit_recv(loop, conn); // every buffer was busy, try again
+        return;
+    }
+    if (cqe->res < 0)
+    {
+        conn_destroy(conn);
+        return;
+    }
+
+    if (cqe->res == 0)
+    {
+        conn->peer_closed = 1; // client disconnected
+    }
+    else if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        memcpy(conn->in_buf + conn->in_len, loop->uring->buf_pool + (size_t)bid * RECV_BUF_SIZE,
+               cqe->res);
+        conn->in_len += cqe->res;
+        conn->in_buf[conn->in_len] = '\0';
+        uring_recycle_buffer(loop->uring, bid);
+    }
+
+    connection_received(loop, conn);
+}
+
+/**
+ * @brief Accounts for one completed step of a write chain. When the whole chain is
+ *        done the next round is submitted (or the connection is closed).
+ *        Short transfers break a link, so the later steps come back as cancelled and
+ *        are simply resubmitted from the updated offsets.
+ *
+ * @param loop The event loop running on io_uring.
+ * @param conn The connection being written.
+ * @param op Which step completed (OP_SEND, OP_SPLICE_IN or OP_SPLICE_OUT).
+ * @param res Result of the step: bytes moved or -errno.
+ */
+void uring_handle_write(EventLoop *loop, Connection *conn, int op, int res)
+{
+    if (res < 0)
+    {
+        if (res != -ECANCELED)
+            conn->failed = 1;
+    }
+    else if (op == OP_SEND)
+    {
+        conn_advance(conn, res);
+        if (res > 0)
+            idle_track(loop, conn, IDLE_WRITE); // the client is reading, restart its deadline
+    }
+    else if (op == OP_SPLICE_IN)
+    {
+        // the send before it completed in full, so the file segment is at the head now
+        if (res == 0)
+            conn->failed = 1; // file shrank underneath us
+        conn->out_head->file_off += res;
+        conn->pipe_bytes += res;
+    }
+    else if (op == OP_SPLICE_OUT)
+    {
+        conn->pipe_bytes -= res;
+        if (res > 0)
+            idle_track(loop, conn, IDLE_WRITE);
+    }
+
+    if (conn->inflight > 0)
+    {
+        return; // rest of the chain is still in the kernel
+    }
+
+    OutSegment *seg = conn->out_head;
+    if (seg != NULL && seg->data == NULL && seg->file_off >= seg->file_end && conn->pipe_bytes == 0)
+    {
+        conn_pop_segment(conn); // file body fully sent
+    }
+    uring_submit_write(loop, conn);
+}
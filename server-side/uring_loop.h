@@ -0,0 +1,22 @@
+/**
+ * Summary: Header file for the io_uring I/O backend of the event loop.
+ *
+ * @file uring_loop.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include "event_loop.h"
+
+#define URING_ENTRIES 256     // submission queue depth
+#define RECV_BUF_COUNT 64     // provided receive buffers (power of two)
+#define RECV_BUF_SIZE 4096    // size of each provided receive buffer
+#define RECV_BUF_GROUP 0      // buffer group id of the provided buffer ring
+
+int uring_loop_init(EventLoop *loop);
+void uring_loop_run(EventLoop *loop);
+void uring_submit_recv(EventLoop *loop, Connection *conn);
+void uring_submit_write(EventLoop *loop, Connection *conn);
+
+#endif
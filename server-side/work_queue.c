@@ -0,0 +1,286 @@
+/**
+ * Summary: Bounded lock-free multi-producer/multi-consumer queue (Vyukov's ring with a sequence
+ *          number per slot). Producers and consumers each claim a position with one
+ *          compare-and-swap on their own counter, so an event loop handing off a connection never
+ *          waits on a worker holding a lock. Consumers that find nothing to do spin briefly and
+ *          then park on a futex (Parking); producers only make the wake syscall when someone is
+ *          parked. One Parking can serve several queues, e.g. a pool of per-worker queues.
+ *
+ * @file work_queue.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE
+
+#include "work_queue.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// --- FUNCTION DECLERATIONS ---
+int work_queue_init(WorkQueue *queue, size_t capacity);
+void work_queue_destroy(WorkQueue *queue);
+int work_queue_push(WorkQueue *queue, void *item);
+void *work_queue_try_pop(WorkQueue *queue);
+size_t work_queue_size(WorkQueue *queue);
+void parking_init(Parking *parking);
+uint32_t parking_prepare(Parking *parking);
+void parking_wait(Parking *parking, uint32_t seen);
+void parking_cancel(Parking *parking);
+void parking_notify(Parking *parking);
+void parking_wake_all(Parking *parking);
+
+// --- HELPER FUNCTIONS ---
+void futex_wait(uint32_t *word, uint32_t expected);
+void futex_wake(uint32_t *word, int count);
+
+// --- FUNCTIONS ---
+/**
+ * @brief Allocates the ring. Slot i starts with sequence i, meaning it is free
+ *        for the producer that claims enqueue position i.
+ *
+ * @param queue The queue to initialize.
+ * @param capacity Number of slots, rounded up to a power of two.
+ * @return 0 on success, -1 on failure.
+ */
+int work_queue_init(WorkQueue *queue, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+    {
+        size *= 2;
+    }
+
+    queue->slots = aligned_alloc(CACHE_LINE, ((size * sizeof(QueueSlot) + CACHE_LINE - 1) / CACHE_LINE) * CACHE_LINE);
+    if (queue->slots == NULL)
+    {
+        perror(" - ❌ Error: failed to allocate work queue");
+        return -1;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        queue->slots[i].seq = i;
+        queue->slots[i].item = NULL;
+    }
+    queue->mask = size - 1;
+    queue->enqueue_pos = 0;
+    queue->dequeue_pos = 0;
+    return 0;
+}
+
+/**
+ * @brief Frees the ring. Items still queued are not touched.
+ *
+ * @param queue The queue to destroy.
+ */
+void work_queue_destroy(WorkQueue *queue)
+{
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+/**
+ * @brief Adds an item without blocking. The caller wakes consumers with
+ *        parking_notify() once it is done pushing.
+ *
+ * @param queue The queue.
+ * @param item The item to add.
+ * @return 0 on success, -1 if the queue is full.
+ */
+int work_queue_push(WorkQueue *queue, void *item)
+{
+    size_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    QueueSlot *slot;
+
+    for (;;)
+    {
+        slot = &queue->slots[pos & queue->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0)
+        {
+            // slot is free for this lap; claim the position
+            if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return -1; // the consumer of the previous lap has not freed it: full
+        }
+        else
+        {
+            pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->item = item;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Removes the oldest item without blocking.
+ *
+ * @param queue The queue.
+ * @return The item, or NULL if the queue is empty.
+ */
+void *work_queue_try_pop(WorkQueue *queue)
+{
+    size_t pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    QueueSlot *slot;
+
+    for (;;)
+    {
+        slot = &queue->slots[pos & queue->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0)
+        {
+            // slot was filled for this position; claim it
+            if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return NULL; // the producer for this position has not published yet: empty
+        }
+        else
+        {
+            pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    void *item = slot->item;
+    // hand the slot to the producer of the next lap
+    __atomic_store_n(&slot->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+/**
+ * @brief Approximate number of queued items, for statistics only.
+ *
+ * @param queue The queue.
+ * @return Items pushed and not yet popped at the moment of reading.
+ */
+size_t work_queue_size(WorkQueue *queue)
+{
+    size_t tail = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    size_t head = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    return head > tail ? head - tail : 0;
+}
+
+/**
+ * @brief Sets up an empty parking spot. Spinning before parking is only
+ *        enabled when there is another CPU for the producer to run on.
+ *
+ * @param parking The parking spot to initialize.
+ */
+void parking_init(Parking *parking)
+{
+    parking->futex_word = 0;
+    parking->sleepers = 0;
+    parking->spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? QUEUE_SPIN_COUNT : 0;
+}
+
+/**
+ * @brief Registers the caller as about to sleep. The caller must look for
+ *        work once more afterwards, then either parking_wait() with the
+ *        returned value or parking_cancel() if it found some.
+ *
+ * @param parking The parking spot.
+ * @return The futex word as seen before registering.
+ */
+uint32_t parking_prepare(Parking *parking)
+{
+    uint32_t seen = __atomic_load_n(&parking->futex_word, __ATOMIC_ACQUIRE);
+    __atomic_fetch_add(&parking->sleepers, 1, __ATOMIC_RELAXED);
+
+    // pairs with the fence in parking_notify(): either our last look finds the
+    // producer's item, or the producer sees us and moves the futex word under us
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return seen;
+}
+
+/**
+ * @brief Sleeps until a producer notifies, unless one already has since
+ *        parking_prepare(). Spurious wakeups are fine: callers look again.
+ *
+ * @param parking The parking spot.
+ * @param seen The value parking_prepare() returned.
+ */
+void parking_wait(Parking *parking, uint32_t seen)
+{
+    futex_wait(&parking->futex_word, seen);
+    __atomic_fetch_sub(&parking->sleepers, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Withdraws a parking_prepare() after finding work on the last look.
+ *
+ * @param parking The parking spot.
+ */
+void parking_cancel(Parking *parking)
+{
+    __atomic_fetch_sub(&parking->sleepers, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Wakes one parked consumer after an item was pushed. Costs a fence
+ *        and a load when nobody is parked, which is the case under load.
+ *
+ * @param parking The parking spot.
+ */
+void parking_notify(Parking *parking)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&parking->sleepers, __ATOMIC_RELAXED) > 0)
+    {
+        __atomic_fetch_add(&parking->futex_word, 1, __ATOMIC_RELEASE);
+        futex_wake(&parking->futex_word, 1);
+    }
+}
+
+/**
+ * @brief Wakes every parked consumer, e.g. so they re-check whether they
+ *        should exit. Always moves the futex word, so a consumer between
+ *        parking_prepare() and parking_wait() does not go to sleep either.
+ *
+ * @param parking The parking spot.
+ */
+void parking_wake_all(Parking *parking)
+{
+    __atomic_fetch_add(&parking->futex_word, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&parking->futex_word, INT_MAX);
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief Sleeps until the futex word is woken, unless it no longer holds the
+ *        expected value. Spurious and signal wakeups are fine: callers re-check.
+ *
+ * @param word The futex word.
+ * @param expected The value read before deciding to sleep.
+ */
+void futex_wait(uint32_t *word, uint32_t expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+/**
+ * @brief Wakes up to count threads sleeping on the futex word.
+ *
+ * @param word The futex word.
+ * @param count Maximum number of threads to wake.
+ */
+void futex_wake(uint32_t *word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
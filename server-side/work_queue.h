@@ -0,0 +1,62 @@
+/**
+ * Summary: Header file for the bounded lock-free multi-producer/multi-consumer work queue
+ *          that hands connections from the event loops to the workers, and the futex its
+ *          idle consumers park on.
+ *
+ * @file work_queue.h
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_LINE 64
+#define QUEUE_SPIN_COUNT 200 // empty polls before an idle consumer parks on the futex
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+// one cell of the ring; seq says whose turn it is (see work_queue.c)
+typedef struct QueueSlot
+{
+    size_t seq;
+    void *item;
+} QueueSlot;
+
+typedef struct WorkQueue
+{
+    QueueSlot *slots;
+    size_t mask; // capacity - 1, capacity is a power of two
+
+    // producers and consumers each advance their own counter, kept on separate cache lines
+    size_t enqueue_pos __attribute__((aligned(CACHE_LINE)));
+    size_t dequeue_pos __attribute__((aligned(CACHE_LINE)));
+} WorkQueue;
+
+// where idle consumers of one or more queues sleep; producers only touch futex_word when someone does
+typedef struct Parking
+{
+    uint32_t futex_word __attribute__((aligned(CACHE_LINE)));
+    int sleepers;
+    int spin_limit; // QUEUE_SPIN_COUNT, or 0 on a single CPU where spinning only delays the producer
+} Parking;
+
+int work_queue_init(WorkQueue *queue, size_t capacity);
+void work_queue_destroy(WorkQueue *queue);
+int work_queue_push(WorkQueue *queue, void *item);
+void *work_queue_try_pop(WorkQueue *queue);
+size_t work_queue_size(WorkQueue *queue);
+
+void parking_init(Parking *parking);
+uint32_t parking_prepare(Parking *parking);
+void parking_wait(Parking *parking, uint32_t seen);
+void parking_cancel(Parking *parking);
+void parking_notify(Parking *parking);
+void parking_wake_all(Parking *parking);
+
+#endif
@@ -0,0 +1,229 @@
+/**
+ * Summary: Build-time generator for the known HTTP header table. Reads the header names
+ *          from a list file and writes a C header with a KnownHeader id per name and a
+ *          perfect hash table, so the request parser maps a (case-insensitive) header
+ *          name to its id with one hash and one comparison.
+ *
+ *          usage: gen_headers <known_headers.txt> > known_headers.h
+ *
+ * @file gen_headers.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NAMES 128
+#define NAME_LEN 64
+#define MAX_TABLE_SIZE 1024
+#define MAX_SEEDS 1000000
+
+char names[MAX_NAMES][NAME_LEN];
+int num_names = 0;
+
+// --- FUNCTION DECLERATIONS ---
+int read_names(const char *path);
+uint32_t fold_hash(uint32_t seed, const char *key, size_t len, uint32_t table_size);
+int try_seed(uint32_t seed, uint32_t table_size, int *slots);
+void write_header(const char *source, uint32_t seed, uint32_t table_size, const int *slots);
+
+// --- FUNCTIONS ---
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <known_headers.txt>\n", argv[0]);
+        return 1;
+    }
+    if (read_names(argv[1]) < 0)
+    {
+        return 1;
+    }
+
+    // smallest power of two table (at least twice the names) for which some seed has no collisions
+    static int slots[MAX_TABLE_SIZE];
+    for (uint32_t table_size = 2; table_size <= MAX_TABLE_SIZE; table_size *= 2)
+    {
+        if (table_size < 2 * (uint32_t)num_names)
+            continue;
+
+        for (uint32_t seed = 0; seed < MAX_SEEDS; seed++)
+        {
+            if (try_seed(seed, table_size, slots))
+            {
+                write_header(argv[1], seed, table_size, slots);
+                return 0;
+            }
+        }
+    }
+
+    fprintf(stderr, " - ❌ Error: no perfect hash found for %d header names\n", num_names);
+    return 1;
+}
+
+/**
+ * @brief Reads one header name per line, skipping blank lines and '#' comments.
+ *
+ * @param path The list file.
+ * @return 0 on success, -1 on failure.
+ */
+int read_names(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(" - ❌ Error: could not open header list");
+        return -1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char *start = line;
+        while (isspace((unsigned char)*start))
+            start++;
+        char *end = start + strlen(start);
+        while (end > start && isspace((unsigned char)end[-1]))
+            end--;
+        *end = '\0';
+
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        if (num_names == MAX_NAMES || end - start >= NAME_LEN)
+        {
+            fprintf(stderr, " - ❌ Error: too many or too long header names at \"%s\"\n", start);
+            fclose(file);
+            return -1;
+        }
+        strcpy(names[num_names++], start);
+    }
+
+    fclose(file);
+    return num_names > 0 ? 0 : -1;
+}
+
+/**
+ * @brief The hash the generated header_slot() computes: FNV-1a over the
+ *        ASCII-lowercased bytes, seeded with the seed and the length.
+ *        Must stay identical to the code emitted by write_header().
+ *
+ * @param seed Seed picked by the generator.
+ * @param key The header name.
+ * @param len Length of the header name.
+ * @param table_size Power of two table size.
+ * @return The table slot for the name.
+ */
+uint32_t fold_hash(uint32_t seed, const char *key, size_t len, uint32_t table_size)
+{
+    uint32_t h = seed ^ (uint32_t)len;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)key[i] | 0x20;
+        h *= 0x01000193u;
+    }
+    return (h ^ (h >> 15)) & (table_size - 1);
+}
+
+/**
+ * @brief Places every name with the given seed, failing on the first collision.
+ *
+ * @param seed Seed to try.
+ * @param table_size Power of two table size.
+ * @param slots Receives the name index for each slot, -1 for empty slots.
+ * @return 1 if the seed gives a perfect hash, 0 otherwise.
+ */
+int try_seed(uint32_t seed, uint32_t table_size, int *slots)
+{
+    for (uint32_t i = 0; i < table_size; i++)
+    {
+        slots[i] = -1;
+    }
+
+    for (int i = 0; i < num_names; i++)
+    {
+        uint32_t slot = fold_hash(seed, names[i], strlen(names[i]), table_size);
+        if (slots[slot] != -1)
+            return 0;
+        slots[slot] = i;
+    }
+    return 1;
+}
+
+/**
+ * @brief Writes the generated header to stdout.
+ *
+ * @param source The list file, named in the generated comment.
+ * @param seed The seed that gave a perfect hash.
+ * @param table_size The table size it was found for.
+ * @param slots Name index for each slot, -1 for empty slots.
+ */
+void write_header(const char *source, uint32_t seed, uint32_t table_size, const int *slots)
+{
+    printf("/**\n"
+           " * Summary: Known HTTP header ids and their perfect hash table.\n"
+           " *          GENERATED by tools/gen_headers from %s -- do not edit.\n"
+           " *\n"
+           " * @file known_headers.h\n"
+           " */\n"
+           "#ifndef KNOWN_HEADERS_H\n"
+           "#define KNOWN_HEADERS_H\n\n"
+           "#include <stddef.h>\n"
+           "#include <stdint.h>\n\n",
+           source);
+
+    printf("typedef enum KnownHeader\n{\n");
+    for (int i = 0; i < num_names; i++)
+    {
+        printf("    HEADER_");
+        for (const char *c = names[i]; *c; c++)
+        {
+            putchar(*c == '-' ? '_' : toupper((unsigned char)*c));
+        }
+        printf(",\n");
+    }
+    printf("    NUM_KNOWN_HEADERS,\n"
+           "    HEADER_OTHER = NUM_KNOWN_HEADERS\n"
+           "} KnownHeader;\n\n");
+
+    printf("#define HEADER_HASH_SEED 0x%08xu\n"
+           "#define HEADER_TABLE_SIZE %u\n\n",
+           seed, table_size);
+
+    printf("typedef struct KnownHeaderSlot\n"
+           "{\n"
+           "    const char *name; // canonical spelling, \"\" for an empty slot\n"
+           "    uint8_t len;\n"
+           "    uint8_t id;\n"
+           "} KnownHeaderSlot;\n\n");
+
+    printf("static const KnownHeaderSlot known_header_table[HEADER_TABLE_SIZE] = {\n");
+    for (uint32_t i = 0; i < table_size; i++)
+    {
+        if (slots[i] < 0)
+        {
+            printf("    {\"\", 0, HEADER_OTHER},\n");
+        }
+        else
+        {
+            printf("    {\"%s\", %zu, %d},\n", names[slots[i]], strlen(names[slots[i]]), slots[i]);
+        }
+    }
+    printf("};\n\n");
+
+    printf("// FNV-1a over the lowercased name; every known name lands in its own slot\n"
+           "static inline uint32_t header_slot(const char *key, size_t len)\n"
+           "{\n"
+           "    uint32_t h = HEADER_HASH_SEED ^ (uint32_t)len;\n\n"
+           "    for (size_t i = 0; i < len; i++)\n"
+           "    {\n"
+           "        h ^= (unsigned char)key[i] | 0x20;\n"
+           "        h *= 0x01000193u;\n"
+           "    }\n"
+           "    return (h ^ (h >> 15)) & (HEADER_TABLE_SIZE - 1);\n"
+           "}\n\n"
+           "#endif\n");
+}
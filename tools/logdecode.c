@@ -0,0 +1,309 @@
+/**
+ * Summary: Decoder for the server's binary access log (-A). Resolves each record's path hash
+ *          through the path entries of the same file and prints one line per request, either
+ *          as text or as JSON (one object per line). Give rotated files oldest first to get the
+ *          requests in order.
+ *
+ *          usage: logdecode [-j] <access_log>...
+ *
+ * @file logdecode.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#include "access_log.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MIN_PATH_SLOTS 1024
+
+// hash -> path for one file, open addressing
+typedef struct PathTable
+{
+    uint32_t *hashes; // 0 = empty
+    const char **paths;
+    uint16_t *lengths;
+    size_t slots;
+    size_t count;
+} PathTable;
+
+// --- FUNCTION DECLERATIONS ---
+int decode_file(const char *name, int json);
+size_t next_entry(const char *map, size_t size, size_t offset);
+int add_path(PathTable *table, const AccessPath *entry);
+const char *find_path(const PathTable *table, uint32_t hash, uint16_t *length);
+void print_text(const AccessRecord *record, const char *path, uint16_t length);
+void print_json(const AccessRecord *record, const char *path, uint16_t length);
+
+// --- FUNCTIONS ---
+int main(int argc, char *argv[])
+{
+    int json = 0;
+    int first = 1;
+
+    if (argc > 1 && strcmp(argv[1], "-j") == 0)
+    {
+        json = 1;
+        first = 2;
+    }
+    if (first >= argc)
+    {
+        fprintf(stderr, "usage: %s [-j] <access_log>...\n"
+                        "  -j  print one JSON object per request instead of text\n",
+                argv[0]);
+        return 1;
+    }
+
+    int result = 0;
+    for (int i = first; i < argc; i++)
+    {
+        if (decode_file(argv[i], json) < 0)
+            result = 1;
+    }
+    return result;
+}
+
+/**
+ * @brief Prints every request in one access log file. Paths are collected in
+ *        a first pass, since a record can be written before the entry that
+ *        interns its path.
+ *
+ * @param name The file.
+ * @param json 1 for JSON output, 0 for text.
+ * @return 0 on success, -1 if the file cannot be read or is not an access log.
+ */
+int decode_file(const char *name, int json)
+{
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(name);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const AccessLogHeader *header = NULL;
+    char *map = MAP_FAILED;
+    if (size >= sizeof(AccessLogHeader))
+    {
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        header = (const AccessLogHeader *)map;
+    }
+    close(fd);
+
+    if (map == MAP_FAILED || memcmp(header->magic, ACCESS_LOG_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != ACCESS_LOG_VERSION || header->entry_size != ACCESS_ENTRY_SIZE)
+    {
+        fprintf(stderr, "%s: not an access log (version %d)\n", name, ACCESS_LOG_VERSION);
+        if (map != MAP_FAILED)
+            munmap(map, size);
+        return -1;
+    }
+
+    PathTable table = {0};
+    size_t offset;
+    for (offset = sizeof(AccessLogHeader); offset < size; offset = next_entry(map, size, offset))
+    {
+        const AccessPath *entry = (const AccessPath *)(map + offset);
+        if (entry->type != ACCESS_ENTRY_PATH || entry->length > ACCESS_PATH_MAX ||
+            offset + access_path_entry_size(entry->length) > size)
+            continue;
+        if (add_path(&table, entry) < 0)
+        {
+            fprintf(stderr, "%s: out of memory\n", name);
+            munmap(map, size);
+            return -1;
+        }
+    }
+
+    for (offset = sizeof(AccessLogHeader); offset < size; offset = next_entry(map, size, offset))
+    {
+        const AccessRecord *record = (const AccessRecord *)(map + offset);
+        if (record->type != ACCESS_ENTRY_REQUEST)
+            continue;
+
+        uint16_t length = 0;
+        const char *path = find_path(&table, record->path_hash, &length);
+        if (json)
+            print_json(record, path, length);
+        else
+            print_text(record, path, length);
+    }
+
+    free(table.hashes);
+    free(table.paths);
+    free(table.lengths);
+    munmap(map, size);
+    return 0;
+}
+
+/**
+ * @brief Steps over the entry at offset. Free space (the unwritten end of the
+ *        file, or an entry whose writer never finished) is stepped over one
+ *        entry at a time.
+ *
+ * @param map The mapped file.
+ * @param size Its size.
+ * @param offset Start of the current entry.
+ * @return Start of the next entry, or size at the end of the file.
+ */
+size_t next_entry(const char *map, size_t size, size_t offset)
+{
+    const AccessPath *entry = (const AccessPath *)(map + offset);
+    size_t step = ACCESS_ENTRY_SIZE;
+
+    if (offset + ACCESS_ENTRY_SIZE > size)
+        return size;
+    if (entry->type == ACCESS_ENTRY_PATH && entry->length <= ACCESS_PATH_MAX)
+        step = access_path_entry_size(entry->length);
+    return offset + step < size ? offset + step : size;
+}
+
+/**
+ * @brief Remembers a path entry, growing the table when it is half full.
+ *
+ * @param table The table.
+ * @param entry The path entry (its path runs on past the struct).
+ * @return 0 on success, -1 on allocation failure.
+ */
+int add_path(PathTable *table, const AccessPath *entry)
+{
+    if (2 * (table->count + 1) > table->slots)
+    {
+        PathTable grown = {0};
+        grown.slots = table->slots ? table->slots * 2 : MIN_PATH_SLOTS;
+        grown.hashes = calloc(grown.slots, sizeof(uint32_t));
+        grown.paths = calloc(grown.slots, sizeof(const char *));
+        grown.lengths = calloc(grown.slots, sizeof(uint16_t));
+        if (grown.hashes == NULL || grown.paths == NULL || grown.lengths == NULL)
+        {
+            free(grown.hashes);
+            free(grown.paths);
+            free(grown.lengths);
+            return -1;
+        }
+
+        for (size_t i = 0; i < table->slots; i++)
+        {
+            if (table->hashes[i] == 0)
+                continue;
+            size_t slot = table->hashes[i] & (grown.slots - 1);
+            while (grown.hashes[slot] != 0)
+                slot = (slot + 1) & (grown.slots - 1);
+            grown.hashes[slot] = table->hashes[i];
+            grown.paths[slot] = table->paths[i];
+            grown.lengths[slot] = table->lengths[i];
+            grown.count++;
+        }
+        free(table->hashes);
+        free(table->paths);
+        free(table->lengths);
+        *table = grown;
+    }
+
+    size_t slot = entry->path_hash & (table->slots - 1);
+    while (table->hashes[slot] != 0)
+    {
+        if (table->hashes[slot] == entry->path_hash)
+            return 0; // interned again (crowded intern table or a rotation race)
+        slot = (slot + 1) & (table->slots - 1);
+    }
+    table->hashes[slot] = entry->path_hash;
+    table->paths[slot] = (const char *)entry + offsetof(AccessPath, path);
+    table->lengths[slot] = entry->length;
+    table->count++;
+    return 0;
+}
+
+/**
+ * @brief Looks up the path for a hash.
+ *
+ * @param table The table.
+ * @param hash The record's path hash.
+ * @param length Receives the path length.
+ * @return The path (not null terminated), or NULL if the file has no entry for it.
+ */
+const char *find_path(const PathTable *table, uint32_t hash, uint16_t *length)
+{
+    if (table->slots == 0)
+        return NULL;
+
+    size_t slot = hash & (table->slots - 1);
+    while (table->hashes[slot] != 0)
+    {
+        if (table->hashes[slot] == hash)
+        {
+            *length = table->lengths[slot];
+            return table->paths[slot];
+        }
+        slot = (slot + 1) & (table->slots - 1);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Prints a record as a text line in the style of the server log.
+ *
+ * @param record The record.
+ * @param path Its path, or NULL to print the hash instead.
+ * @param length The path length.
+ */
+void print_text(const AccessRecord *record, const char *path, uint16_t length)
+{
+    time_t seconds = (time_t)(record->time_ns / 1000000000ull);
+    struct tm tm;
+    char date[32];
+    localtime_r(&seconds, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+    printf("%s.%03u [fd %d] ", date, (unsigned)(record->time_ns / 1000000 % 1000), record->fd);
+    if (path != NULL)
+        printf("%.*s", (int)length, path);
+    else
+        printf("#%08x", record->path_hash);
+    printf(" -> Status: %u, %llu bytes, %u us\n", record->status,
+           (unsigned long long)record->bytes, record->latency_us);
+}
+
+/**
+ * @brief Prints a record as a JSON object on one line.
+ *
+ * @param record The record.
+ * @param path Its path, or NULL to print the hash instead.
+ * @param length The path length.
+ */
+void print_json(const AccessRecord *record, const char *path, uint16_t length)
+{
+    time_t seconds = (time_t)(record->time_ns / 1000000000ull);
+    struct tm tm;
+    char date[32];
+    gmtime_r(&seconds, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    printf("{\"time\": \"%s.%03uZ\", \"fd\": %d, \"path\": \"", date,
+           (unsigned)(record->time_ns / 1000000 % 1000), record->fd);
+    if (path == NULL)
+    {
+        printf("#%08x", record->path_hash);
+    }
+    for (uint16_t i = 0; path != NULL && i < length; i++)
+    {
+        unsigned char c = (unsigned char)path[i];
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    printf("\", \"status\": %u, \"bytes\": %llu, \"latency_us\": %u}\n", record->status,
+           (unsigned long long)record->bytes, record->latency_us);
+}
@@ -0,0 +1,426 @@
+/**
+ * Summary: Pack builder. Scans a document root exactly as the server indexes it and writes one
+ *          file the server maps with -P: a header, the URL index, the strings (URLs, file paths
+ *          and each file's prepared response header) and then every file's body starting on a
+ *          page of its own. Each entry also records its file's ETag and mtime, so revalidations
+ *          are answered with a 304 from the index alone. URLs naming the same file ("/", "/index.html") share one body. A
+ *          file's precompressed sidecars (.gz, .zst, .br) are also entered under its URL, with
+ *          its header plus Content-Encoding, so the server negotiates them from the pack. The
+ *          pack is written next to its destination and renamed over it, so a running server
+ *          keeps the old one until it restarts.
+ *
+ *          usage: mkpack <docroot> <pack>
+ *
+ * @file mkpack.c
+ * @authors: Anna Running Rabbit, Joseph Mills, Jordan Senko
+ */
+#define _GNU_SOURCE
+
+#include "docroot.h"
+#include "file_cache.h" // file_header(), file_etag()
+#include "pack.h"
+#include "server.h" // PATH_LEN
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COPY_CHUNK (256 << 10)
+
+// one file going into the pack, shared by every URL that serves it
+typedef struct PackFile
+{
+    const char *fs_path;
+    size_t size;
+    struct stat st; // its validators, as of when it was sized
+    char etag[FILE_CACHE_ETAG_LEN];
+    char *header;
+    int header_len;
+    ContentEncoding encoding; // set when the file is some other file's sidecar
+    char *encoded_header;     // its header when sent in place of that file
+    int encoded_header_len;
+    uint64_t path_offset;
+    uint64_t etag_offset;
+    uint64_t header_offset;
+    uint64_t encoded_header_offset;
+    uint64_t body_offset;
+} PackFile;
+
+// --- FUNCTION DECLERATIONS ---
+int build_pack(const char *root, const char *pack_path);
+int write_pack(int fd, const DocIndex *index, PackFile *files, size_t num_files, const PackFile **owners,
+               size_t count);
+
+// --- HELPER FUNCTIONS ---
+int compare_paths(const void *a, const void *b);
+int copy_body(int fd, const PackFile *file);
+int write_at(int fd, const void *data, size_t len, uint64_t offset);
+uint64_t align_up(uint64_t value, uint64_t align);
+
+// --- FUNCTIONS ---
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <docroot> <pack>\n"
+                        "  bundles every file under docroot into pack, served with ./server -P pack\n",
+                argv[0]);
+        return 1;
+    }
+    return build_pack(argv[1], argv[2]) < 0 ? 1 : 0;
+}
+
+/**
+ * @brief Indexes the document root, sizes every file and writes the pack.
+ *
+ * @param root The document root.
+ * @param pack_path Where the pack goes.
+ * @return 0 on success, -1 on failure (the destination is left untouched).
+ */
+int build_pack(const char *root, const char *pack_path)
+{
+    DocIndex *index = build_index(root);
+    if (index == NULL)
+    {
+        fprintf(stderr, " - ❌ Error: could not index document root %s\n", root);
+        return -1;
+    }
+
+    // group the URLs by the file they serve, so each file is stored once
+    const DocEntry **sorted = calloc(index->count ? index->count : 1, sizeof(DocEntry *));
+    PackFile *files = calloc(index->count ? index->count : 1, sizeof(PackFile));
+    const PackFile **owners = calloc(index->slots ? index->slots : 1, sizeof(PackFile *));
+    size_t num_sorted = 0;
+    size_t num_files = 0;
+    int result = -1;
+    if (sorted == NULL || files == NULL || owners == NULL)
+    {
+        fprintf(stderr, " - ❌ Error: out of memory\n");
+        goto done;
+    }
+    for (size_t i = 0; i < index->slots; i++)
+    {
+        if (index->entries[i].hash != 0)
+            sorted[num_sorted++] = &index->entries[i];
+    }
+    qsort(sorted, num_sorted, sizeof(DocEntry *), compare_paths);
+
+    for (size_t i = 0; i < num_sorted; i++)
+    {
+        if (num_files == 0 || strcmp(files[num_files - 1].fs_path, sorted[i]->fs_path) != 0)
+        {
+            PackFile *file = &files[num_files++];
+            file->fs_path = sorted[i]->fs_path;
+            if (stat(file->fs_path, &file->st) < 0 || !S_ISREG(file->st.st_mode))
+            {
+                fprintf(stderr, " - ❌ Error: could not stat %s\n", file->fs_path);
+                goto done;
+            }
+            file->size = (size_t)file->st.st_size;
+            file_etag(file->fs_path, &file->st, ENCODING_IDENTITY, file->etag, sizeof(file->etag));
+            file->header_len = file_header(file->fs_path, &file->st, file->size, ENCODING_IDENTITY, &file->header);
+            if (file->header_len < 0)
+            {
+                fprintf(stderr, " - ❌ Error: out of memory\n");
+                goto done;
+            }
+        }
+        owners[sorted[i] - index->entries] = &files[num_files - 1];
+    }
+
+    // every sidecar a URL can be answered with becomes one more entry, with its own header
+    size_t count = index->count;
+    for (size_t i = 0; i < index->slots; i++)
+    {
+        for (int encoding = 1; index->entries[i].hash != 0 && encoding < NUM_ENCODINGS; encoding++)
+        {
+            const DocEntry *sidecar = index->entries[i].variants[encoding];
+            if (sidecar == NULL)
+                continue;
+
+            PackFile *file = (PackFile *)owners[sidecar - index->entries];
+            if (file->encoded_header == NULL)
+            {
+                file->encoding = (ContentEncoding)encoding;
+                file->encoded_header_len =
+                    file_header(file->fs_path, &file->st, file->size, file->encoding, &file->encoded_header);
+                if (file->encoded_header_len < 0)
+                {
+                    fprintf(stderr, " - ❌ Error: out of memory\n");
+                    goto done;
+                }
+            }
+            count++;
+        }
+    }
+
+    // written beside the destination, then renamed over it in one step
+    char tmp_path[PATH_LEN];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", pack_path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror(tmp_path);
+        goto done;
+    }
+    result = write_pack(fd, index, files, num_files, owners, count);
+    if (close(fd) < 0)
+        result = -1;
+    if (result == 0 && rename(tmp_path, pack_path) < 0)
+    {
+        perror(pack_path);
+        result = -1;
+    }
+    if (result < 0)
+        unlink(tmp_path);
+    else
+        printf(" - ✔️ Packed %zu paths (%zu files, %zu encoded variants) from %s into %s\n", index->count,
+               num_files, count - index->count, root, pack_path);
+
+done:
+    for (size_t i = 0; files != NULL && i < num_files; i++)
+    {
+        free(files[i].header);
+        free(files[i].encoded_header);
+    }
+    free(sorted);
+    free(files);
+    free(owners);
+    free_index(index);
+    return result;
+}
+
+/**
+ * @brief Lays the pack out and writes it: header, index, strings, then the
+ *        page aligned bodies.
+ *
+ * @param fd The file being written.
+ * @param index The document root index.
+ * @param files The distinct files, sized and with their headers.
+ * @param num_files How many there are.
+ * @param owners For each index slot, the file its URL serves.
+ * @param count Entries to write: the URLs plus the sidecars they can be answered with.
+ * @return 0 on success, -1 on a write error or a file that changed while packing.
+ */
+int write_pack(int fd, const DocIndex *index, PackFile *files, size_t num_files, const PackFile **owners,
+               size_t count)
+{
+    // the pack's own table has room to spare like the server's, so probes stay short
+    uint64_t slots = 1;
+    while (slots < 2 * (uint64_t)count + 1)
+        slots <<= 1;
+    PackEntry *entries = calloc(slots, sizeof(PackEntry));
+    if (entries == NULL)
+        return -1;
+
+    // strings: each file's path, ETag and header once, then every URL
+    uint64_t offset = sizeof(PackHeader) + slots * sizeof(PackEntry);
+    int result = 0;
+    for (size_t i = 0; i < num_files && result == 0; i++)
+    {
+        PackFile *file = &files[i];
+        size_t path_len = strlen(file->fs_path);
+        file->path_offset = offset;
+        result |= write_at(fd, file->fs_path, path_len + 1, offset);
+        offset += path_len + 1;
+        file->etag_offset = offset;
+        result |= write_at(fd, file->etag, strlen(file->etag) + 1, offset);
+        offset += strlen(file->etag) + 1;
+        file->header_offset = offset;
+        result |= write_at(fd, file->header, (size_t)file->header_len, offset);
+        offset += (uint64_t)file->header_len;
+        if (file->encoded_header != NULL)
+        {
+            file->encoded_header_offset = offset;
+            result |= write_at(fd, file->encoded_header, (size_t)file->encoded_header_len, offset);
+            offset += (uint64_t)file->encoded_header_len;
+        }
+    }
+    uint64_t urls_offset = offset;
+    for (size_t i = 0; i < index->slots; i++)
+    {
+        if (index->entries[i].hash != 0)
+            offset += strlen(index->entries[i].url) + 1;
+    }
+
+    // bodies: each on its own pages, so none shares a page with another file
+    for (size_t i = 0; i < num_files && result == 0; i++)
+    {
+        offset = align_up(offset, PACK_ALIGN);
+        files[i].body_offset = offset;
+        result |= copy_body(fd, &files[i]);
+        offset += files[i].size;
+    }
+
+    offset = urls_offset;
+    for (size_t i = 0; i < index->slots && result == 0; i++)
+    {
+        const DocEntry *doc = &index->entries[i];
+        if (doc->hash == 0)
+            continue;
+
+        // the URL itself, then each sidecar under the same URL and hash
+        int vary = 0;
+        for (int encoding = 1; encoding < NUM_ENCODINGS; encoding++)
+            vary |= doc->variants[encoding] != NULL;
+        for (int encoding = 0; encoding < NUM_ENCODINGS; encoding++)
+        {
+            const PackFile *file = owners[i];
+            if (encoding != ENCODING_IDENTITY)
+            {
+                if (doc->variants[encoding] == NULL)
+                    continue;
+                file = owners[doc->variants[encoding] - index->entries];
+            }
+
+            uint64_t slot = doc->hash & (slots - 1);
+            while (entries[slot].hash != 0)
+                slot = (slot + 1) & (slots - 1);
+
+            PackEntry *entry = &entries[slot];
+            entry->hash = doc->hash;
+            entry->url_len = (uint32_t)strlen(doc->url);
+            entry->url_offset = offset;
+            entry->path_len = (uint32_t)strlen(file->fs_path);
+            entry->path_offset = file->path_offset;
+            entry->encoding = (uint32_t)encoding;
+            entry->vary = (uint32_t)vary;
+            entry->header_len = (uint32_t)(encoding ? file->encoded_header_len : file->header_len);
+            entry->header_offset = encoding ? file->encoded_header_offset : file->header_offset;
+            entry->body_offset = file->body_offset;
+            entry->body_len = file->size;
+            entry->etag_offset = file->etag_offset;
+            entry->etag_len = (uint32_t)strlen(file->etag);
+            entry->mtime = (int64_t)file->st.st_mtim.tv_sec;
+        }
+        result |= write_at(fd, doc->url, strlen(doc->url) + 1, offset);
+        offset += strlen(doc->url) + 1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    PackHeader header = {0};
+    memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+    header.version = PACK_VERSION;
+    header.count = (uint32_t)count;
+    header.slots = slots;
+    header.index_offset = sizeof(PackHeader);
+    header.size = num_files > 0 ? files[num_files - 1].body_offset + files[num_files - 1].size : offset;
+    header.created_ns = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+
+    if (result == 0)
+        result |= write_at(fd, entries, slots * sizeof(PackEntry), header.index_offset);
+    if (result == 0)
+        result |= write_at(fd, &header, sizeof(header), 0);
+    if (result == 0 && (ftruncate(fd, (off_t)header.size) < 0 || fsync(fd) < 0))
+    {
+        perror("mkpack");
+        result = -1;
+    }
+    free(entries);
+    return result;
+}
+
+// --- HELPER FUNCTIONS ---
+/**
+ * @brief qsort() order of index entries by the file they serve.
+ *
+ * @param a Pointer to the first entry pointer.
+ * @param b Pointer to the second entry pointer.
+ * @return <0, 0 or >0 as for strcmp().
+ */
+int compare_paths(const void *a, const void *b)
+{
+    const DocEntry *left = *(const DocEntry *const *)a;
+    const DocEntry *right = *(const DocEntry *const *)b;
+    return strcmp(left->fs_path, right->fs_path);
+}
+
+/**
+ * @brief Copies one file into the pack at its body offset.
+ *
+ * @param fd The pack being written.
+ * @param file The file, with its size as prepared in the header.
+ * @return 0 on success, -1 if it cannot be read or its size changed.
+ */
+int copy_body(int fd, const PackFile *file)
+{
+    int in = open(file->fs_path, O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+    {
+        perror(file->fs_path);
+        return -1;
+    }
+
+    char *buffer = malloc(COPY_CHUNK);
+    size_t done = 0;
+    int result = buffer != NULL ? 0 : -1;
+    while (result == 0)
+    {
+        ssize_t n = read(in, buffer, COPY_CHUNK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            result = n == 0 && done == file->size ? 0 : -1;
+            break;
+        }
+        if (done + (size_t)n > file->size)
+        {
+            result = -1; // grew since its header was prepared
+            break;
+        }
+        result = write_at(fd, buffer, (size_t)n, file->body_offset + done);
+        done += (size_t)n;
+    }
+    if (result < 0)
+        fprintf(stderr, " - ❌ Error: could not pack %s (changed while packing?)\n", file->fs_path);
+
+    free(buffer);
+    close(in);
+    return result;
+}
+
+/**
+ * @brief Writes all of a buffer at an offset of the pack.
+ *
+ * @param fd The pack being written.
+ * @param data The bytes.
+ * @param len How many.
+ * @param offset Where they go.
+ * @return 0 on success, -1 on a write error.
+ */
+int write_at(int fd, const void *data, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = pwrite(fd, (const char *)data + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            perror("mkpack");
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Rounds a value up to a multiple of a power of two.
+ *
+ * @param value The value.
+ * @param align The power of two.
+ * @return The rounded value.
+ */
+uint64_t align_up(uint64_t value, uint64_t align)
+{
+    return (value + align - 1) & ~(align - 1);
+}